@@ -18,72 +18,588 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <errno.h>
 #include "b_io.h"
 #include "mfs.h"
 #include "fsLow.h"
 #include "freeSpaceManagement.h"
+#include "memo.h"
+#include "journal.h"
 
-#define MAXFCBS 20
+#define FCB_TABLE_START 32 // descriptors the table starts with, doubled when full
+#define FCB_SLAB 64        // FCBs allocated together for the pool
 
-// file control block buffer struct
+// Changes to a file's inode held in its FCB (metaDirty)
+#define META_TIMES 1   // timestamps
+#define META_DATA 2    // size, or the bytes of an inline file
+#define META_BLOCKS 4  // location or block count, written before the call returns
+
+// file control block buffer struct. The buffer holds a run of the file's
+// blocks that follow each other in its chain, bufCount of them ending
+// just before currentBlk.
 typedef struct b_fcb
 {
-  char *buf;                // buffer for open file
+  char *buf;                // buffer for open file, bufBlocks blocks long
+  int bufBlocks;            // blocks the buffer can hold
+  int bufCount;             // blocks of the file in the buffer now
+  int64_t *bufBlk;          // location of each block in the buffer
+  int64_t bufPrev;          // block linking to the first one in the buffer
   int index;                // hold the current position in buffer
-  int bufLen;               // number of bytes in the buffer
-  int currentBlk;           // current file system block location
-  int numBlocks;            // current block index number
-  int fileIndex;            // index of file in dirArray
+  int bufLen;               // number of bytes of the file in the buffer
+  int dirtyStart;           // buffer bytes from dirtyStart up to dirtyEnd
+  int dirtyEnd;             // are written but not on disk yet
+  int64_t currentBlk;       // block after the buffer, the next one to fill
+  int64_t prevBlk;          // block linking to currentBlk, -1 at the first
+  int numBlocks;            // index of currentBlk in the file
   int accessMode;           // file access mode
+  int metaDirty;            // META_ flags of inode changes not written yet
+  time_t metaWritten;       // when the inode was last written
   DirectoryEntry *fi;       // holds the low level systems file info
-  DirectoryEntry *dirArray; // holds the directory array where the file resides
+  struct b_fcb *nextFree;   // next FCB in the pool while this one is free
 
 } b_fcb;
 
-b_fcb fcbArray[MAXFCBS];
+// The descriptor table maps each open descriptor to its FCB. Free
+// descriptors are chained through fcbNextFree, and free FCBs through
+// nextFree, so opening and closing never scan the table.
+b_fcb **fcbTable = NULL;  // FCB of each descriptor, NULL if it is free
+int *fcbNextFree = NULL;  // next free descriptor, -1 at the end
+int fcbTableSize = 0;     // descriptors in the table
+int fcbFree = -1;         // first free descriptor, -1 if none
+b_fcb *fcbPool = NULL;    // free FCBs, carved from slabs of FCB_SLAB
 
 int startup = 0; // Indicates that this has not been initialized
 
-// Method to initialize our file system
-void b_init()
+// Grow the descriptor table to size descriptors, the new ones free
+static int growTable(int size)
 {
-  // init fcbArray to all free
-  for (int i = 0; i < MAXFCBS; i++)
+  b_fcb **table = realloc(fcbTable, size * sizeof(b_fcb *));
+  if (table == NULL)
+  {
+    return -1;
+  }
+  fcbTable = table;
+
+  int *nextFree = realloc(fcbNextFree, size * sizeof(int));
+  if (nextFree == NULL)
+  {
+    return -1;
+  }
+  fcbNextFree = nextFree;
+
+  // chained so the lowest new descriptor is handed out first
+  for (int i = size - 1; i >= fcbTableSize; i--)
   {
-    fcbArray[i].buf = NULL; // indicates a free fcbArray
+    fcbTable[i] = NULL;
+    fcbNextFree[i] = fcbFree;
+    fcbFree = i;
   }
+  fcbTableSize = size;
+  return 0;
+}
+
+// Method to initialize our file system
+void b_init()
+{
+  // the table starts small and grows as files are opened
+  growTable(FCB_TABLE_START);
 
   startup = 1;
 }
 
-// Method to get a free FCB element
+// Method to get a free FCB element. Sets errno and returns -1 when
+// B_MAX_OPEN_FILES files are open or memory runs out.
 b_io_fd b_getFCB()
 {
-  for (int i = 0; i < MAXFCBS; i++)
+  if (fcbFree == -1)
   {
-    if (fcbArray[i].buf == NULL)
+    if (fcbTableSize >= B_MAX_OPEN_FILES)
+    {
+      errno = EMFILE;
+      return -1;
+    }
+
+    int size = fcbTableSize > 0 ? fcbTableSize * 2 : FCB_TABLE_START;
+    if (growTable(size > B_MAX_OPEN_FILES ? B_MAX_OPEN_FILES : size) != 0)
+    {
+      errno = ENOMEM;
+      return -1;
+    }
+  }
+
+  // the pool gets another slab when it runs dry, slabs are kept for
+  // reuse rather than freed
+  if (fcbPool == NULL)
+  {
+    b_fcb *slab = malloc(FCB_SLAB * sizeof(b_fcb));
+    if (slab == NULL)
+    {
+      errno = ENOMEM;
+      return -1;
+    }
+
+    for (int i = 0; i < FCB_SLAB; i++)
     {
-      return i; // Not thread safe (But do not worry about it for this assignment)
+      slab[i].nextFree = fcbPool;
+      fcbPool = &slab[i];
     }
   }
-  return (-1); // all in use
+
+  b_io_fd fd = fcbFree; // Not thread safe (But do not worry about it for this assignment)
+  fcbFree = fcbNextFree[fd];
+
+  b_fcb *fcb = fcbPool;
+  fcbPool = fcb->nextFree;
+  memset(fcb, 0, sizeof(b_fcb));
+  fcbTable[fd] = fcb;
+  return fd;
 }
 
-// Interface to open a buffered file
-// Modification of interface for this assignment, flags match the Linux flags for open
-// O_RDONLY, O_WRONLY, or O_RDWR
-b_io_fd b_open(char *filename, int flags)
+// Give a descriptor and its FCB back
+static void releaseFCB(b_io_fd fd)
+{
+  fcbTable[fd]->nextFree = fcbPool;
+  fcbPool = fcbTable[fd];
+
+  fcbTable[fd] = NULL;
+  fcbNextFree[fd] = fcbFree;
+  fcbFree = fd;
+}
+
+// The FCB of an open descriptor, NULL with errno EBADF if fd is not one
+static b_fcb *openFCB(b_io_fd fd)
+{
+  if (startup == 0)
+    b_init(); // Initialize our system
+
+  if (fd < 0 || fd >= fcbTableSize || fcbTable[fd] == NULL || fcbTable[fd]->fi == NULL)
+  {
+    errno = EBADF;
+    return NULL;
+  }
+  return fcbTable[fd];
+}
+
+// Blocks of a buffer of size bytes, at least one and at most B_MAX_BUFFER
+static int bufferBlocks(int size)
+{
+  int blocks = get_num_blocks(size, myVCB->block_size);
+  int most = get_num_blocks(B_MAX_BUFFER, myVCB->block_size);
+  if (blocks < 1)
+  {
+    blocks = 1;
+  }
+  return blocks > most ? most : blocks;
+}
+
+// Offset in the file of the current position
+static uint64_t filePosition(b_io_fd fd)
+{
+  return BLOCKS_TO_BYTES(fcbTable[fd]->numBlocks - fcbTable[fd]->bufCount) + fcbTable[fd]->index;
+}
+
+// Move the FCB on to the next block of the file
+static void nextBlock(b_io_fd fd)
+{
+  fcbTable[fd]->prevBlk = fcbTable[fd]->currentBlk;
+  fcbTable[fd]->currentBlk = get_next_block(fcbTable[fd]->currentBlk);
+}
+
+// Write the file's inode if it has changes in mask held in the FCB. The
+// inode is written whole, so every held change goes with it.
+static int flushMeta(b_io_fd fd, int mask)
+{
+  b_fcb *fcb = fcbTable[fd];
+  if (!(fcb->metaDirty & mask))
+  {
+    return 0;
+  }
+
+  // an inline file's bytes live in its inode
+  if (fcb->fi->num_blocks == 0 && (fcb->metaDirty & META_DATA) &&
+      write_inline_data(fcb->fi->inode, fcb->buf, fcb->fi->size) != 0)
+  {
+    return -1;
+  }
+
+  if (write_inode(fcb->fi) != 0)
+  {
+    return -1;
+  }
+  fcb->metaDirty = 0;
+  fcb->metaWritten = time(NULL);
+  return 0;
+}
+
+// Copy a shared block to a new block of its own, linked to the same
+// next block. Returns the new block or -1.
+static int64_t copyBlock(int64_t block)
+{
+  int64_t copy = allocateBlock(1);
+  if (copy == -1)
+  {
+    return -1;
+  }
+
+  char *data = malloc(myVCB->block_size);
+  if (data == NULL || fs_LBAread(data, 1, block) != 1 || fs_LBAwrite(data, 1, copy) != 1)
+  {
+    free(data);
+    return -1;
+  }
+  free(data);
+
+  set_next_block(copy, get_next_block(block));
+  unshare_block(block);
+  STAT_INC(cow_copies);
+  return copy;
+}
+
+// Give the file its own copy of every shared block from its first up to
+// and including last. A block's link lives in the block before it, so
+// a shared block can only be replaced once the one before is private.
+static int privatizeThrough(b_io_fd fd, int64_t last)
+{
+  int64_t prev = -1;
+  int64_t block = fcbTable[fd]->fi->location;
+
+  while (block != END_OF_CHAIN)
+  {
+    int shared = block_shared(block);
+    if (shared == -1)
+    {
+      return -1;
+    }
+
+    int64_t own = block;
+    if (shared)
+    {
+      own = copyBlock(block);
+      if (own == -1)
+      {
+        return -1;
+      }
+
+      if (prev == -1)
+      {
+        fcbTable[fd]->fi->location = own;
+        fcbTable[fd]->metaDirty |= META_BLOCKS;
+      }
+      else
+      {
+        set_next_block(prev, own);
+      }
+    }
+
+    if (block == last)
+    {
+      return 0;
+    }
+    prev = own;
+    block = get_next_block(own);
+  }
+  return 0;
+}
+
+// Find the blocks of the buffer and the chain position again from the
+// start of the file, after privatizeThrough replaced some of them
+static void remapBuffer(b_io_fd fd)
+{
+  b_fcb *fcb = fcbTable[fd];
+  int64_t prev = -1;
+  int64_t block = fcb->fi->location;
+
+  for (int i = 0; i < fcb->numBlocks - fcb->bufCount && block != END_OF_CHAIN; i++)
+  {
+    prev = block;
+    block = get_next_block(block);
+  }
+
+  fcb->bufPrev = prev;
+  for (int i = 0; i < fcb->bufCount; i++)
+  {
+    fcb->bufBlk[i] = block;
+    prev = block;
+    block = get_next_block(block);
+  }
+
+  fcb->prevBlk = prev;
+  fcb->currentBlk = block;
+}
+
+// Make block i of the buffer private to the file before it is written.
+// The usual case is a sequential write, where the block before is
+// already private and only this block is copied.
+static int makePrivate(b_io_fd fd, int i)
+{
+  b_fcb *fcb = fcbTable[fd];
+  int64_t block = fcb->bufBlk[i];
+  int64_t prev = i > 0 ? fcb->bufBlk[i - 1] : fcb->bufPrev;
+
+  int shared = block_shared(block);
+  if (shared != 1)
+  {
+    return shared;
+  }
+
+  int linked = prev == -1 ? fcb->fi->location == block
+                          : get_next_block(prev) == block && block_shared(prev) == 0;
+  if (!linked)
+  {
+    if (privatizeThrough(fd, block) != 0)
+    {
+      return -1;
+    }
+    remapBuffer(fd);
+    return 0;
+  }
+
+  int64_t own = copyBlock(block);
+  if (own == -1)
+  {
+    return -1;
+  }
+
+  if (prev == -1)
+  {
+    fcb->fi->location = own;
+    fcb->metaDirty |= META_BLOCKS;
+  }
+  else
+  {
+    set_next_block(prev, own);
+  }
+  fcb->bufBlk[i] = own;
+
+  // the block after the buffer links from its last block
+  if (i == fcb->bufCount - 1)
+  {
+    fcb->prevBlk = own;
+  }
+  return 0;
+}
+
+// Add the blocks following the buffer to it until it holds most, or
+// the file runs out of blocks. Returns the number of blocks added.
+static int mapBuffer(b_io_fd fd, int most)
+{
+  b_fcb *fcb = fcbTable[fd];
+  if (fcb->bufCount == 0)
+  {
+    fcb->bufPrev = fcb->prevBlk;
+  }
+
+  int added = 0;
+  while (fcb->bufCount < most && fcb->currentBlk != END_OF_CHAIN &&
+         (unsigned int)fcb->numBlocks < fcb->fi->num_blocks)
+  {
+    fcb->bufBlk[fcb->bufCount++] = fcb->currentBlk;
+    nextBlock(fd);
+    fcb->numBlocks++;
+    added++;
+  }
+  return added;
+}
+
+// Read blocks first to last of the buffer's map into data, which holds
+// block 0 of the map. Each run of adjacent blocks is one LBAread.
+static int readRuns(b_io_fd fd, char *data, int first, int last)
+{
+  int64_t *map = fcbTable[fd]->bufBlk;
+  for (int i = first; i <= last;)
+  {
+    int run = 1;
+    while (i + run <= last && map[i + run] == map[i] + run)
+    {
+      run++;
+    }
+
+    if (fs_LBAread(data + BLOCKS_TO_BYTES(i), run, map[i]) != (uint64_t)run)
+    {
+      return -1;
+    }
+    i += run;
+  }
+  return 0;
+}
+
+// Write blocks first to last of the buffer's map from data, copying any
+// shared one first. Each run of adjacent blocks is one LBAwrite.
+static int writeRuns(b_io_fd fd, char *data, int first, int last)
+{
+  // in file order, so the block linking to each one is private already
+  for (int i = first; i <= last; i++)
+  {
+    if (makePrivate(fd, i) != 0)
+    {
+      return -1;
+    }
+  }
+
+  int64_t *map = fcbTable[fd]->bufBlk;
+  for (int i = first; i <= last;)
+  {
+    int run = 1;
+    while (i + run <= last && map[i + run] == map[i] + run)
+    {
+      run++;
+    }
+
+    if (fs_LBAwrite(data + BLOCKS_TO_BYTES(i), run, map[i]) != (uint64_t)run)
+    {
+      return -1;
+    }
+    i += run;
+  }
+
+  // a copied first block moved the file, the inode must follow the
+  // unshared count into the same journal transaction
+  return flushMeta(fd, META_BLOCKS);
+}
+
+// Read the file's bytes held by the blocks of a newly mapped buffer.
+// Blocks past the end of the file are not read.
+static int loadBuffer(b_io_fd fd)
+{
+  b_fcb *fcb = fcbTable[fd];
+  uint64_t start = BLOCKS_TO_BYTES(fcb->numBlocks - fcb->bufCount);
+  uint64_t held = BLOCKS_TO_BYTES(fcb->bufCount);
+
+  fcb->bufLen = 0;
+  if (fcb->fi->size > start)
+  {
+    fcb->bufLen = fcb->fi->size - start < held ? fcb->fi->size - start : held;
+  }
+
+  if (fcb->bufLen == 0)
+  {
+    return 0;
+  }
+  STAT_INC(file_buffer_fills);
+  return readRuns(fd, fcb->buf, 0, BLOCK_INDEX(fcb->bufLen - 1));
+}
+
+// Write the changed blocks of the buffer to disk
+static int drainBuffer(b_io_fd fd)
+{
+  b_fcb *fcb = fcbTable[fd];
+  if (fcb->dirtyEnd <= fcb->dirtyStart)
+  {
+    return 0;
+  }
+
+  int first = BLOCK_INDEX(fcb->dirtyStart);
+  int last = BLOCK_INDEX(fcb->dirtyEnd - 1);
+  fcb->dirtyStart = 0;
+  fcb->dirtyEnd = 0;
+  STAT_INC(file_buffer_drains);
+  return writeRuns(fd, fcb->buf, first, last);
+}
+
+// Once B_META_SECONDS have passed since the inode was written, write
+// the buffer and then the held inode changes, so the size on disk does
+// not run ahead of the data
+static int periodicFlush(b_io_fd fd)
+{
+  if (fcbTable[fd]->metaDirty == 0 || time(NULL) - fcbTable[fd]->metaWritten < B_META_SECONDS)
+  {
+    return 0;
+  }
+
+  if (fcbTable[fd]->fi->num_blocks > 0 && drainBuffer(fd) != 0)
+  {
+    return -1;
+  }
+  return flushMeta(fd, META_TIMES | META_DATA | META_BLOCKS);
+}
+
+// Note buffer bytes from start up to end as written
+static void markDirty(b_io_fd fd, int start, int end)
+{
+  b_fcb *fcb = fcbTable[fd];
+  if (fcb->dirtyEnd <= fcb->dirtyStart)
+  {
+    fcb->dirtyStart = start;
+    fcb->dirtyEnd = end;
+    return;
+  }
+
+  if (start < fcb->dirtyStart)
+  {
+    fcb->dirtyStart = start;
+  }
+  if (end > fcb->dirtyEnd)
+  {
+    fcb->dirtyEnd = end;
+  }
+}
+
+// Write out and empty the buffer, keeping the position. The chain
+// position moves back to the block holding the current position.
+static int retireBuffer(b_io_fd fd)
+{
+  b_fcb *fcb = fcbTable[fd];
+
+  // an inline file is all in the buffer
+  if (fcb->fi->num_blocks == 0)
+  {
+    return 0;
+  }
+
+  int status = drainBuffer(fd);
+
+  int block = BLOCK_INDEX(fcb->index);
+  if (block < fcb->bufCount)
+  {
+    fcb->currentBlk = fcb->bufBlk[block];
+    fcb->prevBlk = block > 0 ? fcb->bufBlk[block - 1] : fcb->bufPrev;
+    fcb->numBlocks -= fcb->bufCount - block;
+  }
+  else
+  {
+    block = fcb->bufCount;
+  }
+
+  fcb->index -= BLOCKS_TO_BYTES(block);
+  fcb->bufCount = 0;
+  fcb->bufLen = 0;
+  return status;
+}
+
+// Open a buffered file, a relative path starts at the directory at start
+static b_io_fd openAt(uint64_t start, char *filename, int flags)
 {
   b_io_fd returnFd;
   if (startup == 0)
     b_init(); // Initialize our system
 
-  // parse path the dirrectory array
-  DirectoryEntry *dirArray = parsePath(filename);
+  STAT_INC(file_opens);
+
+  ParsedPath path;
+  if (parsePath(filename, &path) != 0)
+  {
+    return -2;
+  }
+
+  // locate the directory holding the file
+  long parent = resolveParentAt(start, &path);
+  if (parent == -1)
+  {
+    perror("b_open: invalid path\n");
+    return -2;
+  }
 
-  char *last_token = get_last_token(filename);
+  const char *last_token = pathLast(&path);
 
-  int found_index = get_de_index(last_token, dirArray);
+  DirectoryEntry entry;
+  int found_index = get_de_index(parent, last_token, &entry);
+
+  // directories cannot be opened as files
+  if (found_index > -1 && entry.attributes != 'f')
+  {
+    perror("b_open: not a file\n");
+    return -2;
+  }
 
   if (found_index < 0)
   {
@@ -103,49 +619,46 @@ b_io_fd b_open(char *filename, int flags)
 
     if (error_occured)
     {
-      free(dirArray);
-      dirArray = NULL;
-      free(last_token);
-      last_token = NULL;
-
       return -2;
     }
   }
 
-  // allocate the file system buffer
-  char *buf = malloc(myVCB->block_size);
-  if (buf == NULL)
+  returnFd = b_getFCB(); // get our own file descriptor
+                         // check for error - table full or no memory
+  if (returnFd == -1)
   {
-    perror("b_open: buffer malloc failed\n");
-    free(dirArray);
-    dirArray = NULL;
-    free(last_token);
-    last_token = NULL;
+    // perror can change errno, the caller gets the reason
+    int reason = errno;
+    perror("b_open: no free file control block");
+    errno = reason;
 
-    return (-1);
+    return -1;
   }
 
-  returnFd = b_getFCB(); // get our own file descriptor
-                         // check for error - all used FCB's
-  if (returnFd == -1)
+  // allocate the file system buffer and the map of its blocks
+  int bufBlocks = bufferBlocks(flags & O_LARGEBUF ? B_LARGE_BUFFER : B_DEFAULT_BUFFER);
+  char *buf = malloc(BLOCKS_TO_BYTES(bufBlocks));
+  int64_t *bufBlk = malloc(bufBlocks * sizeof(int64_t));
+  if (buf == NULL || bufBlk == NULL)
   {
-    perror("no free file control blocks available\n");
-
-    free(dirArray);
-    free(last_token);
+    perror("b_open: buffer malloc failed\n");
 
-    return -1;
+    free(buf);
+    free(bufBlk);
+    releaseFCB(returnFd);
+    return (-1);
   }
 
   // malloc file directory entry
-  fcbArray[returnFd].fi = malloc(sizeof(DirectoryEntry));
+  fcbTable[returnFd]->fi = malloc(sizeof(DirectoryEntry));
 
-  if (fcbArray[returnFd].fi == NULL)
+  if (fcbTable[returnFd]->fi == NULL)
   {
-    perror("Malloc fcbArray file info failed\n");
+    perror("Malloc fcb file info failed\n");
 
-    free(dirArray);
-    free(last_token);
+    free(buf);
+    free(bufBlk);
+    releaseFCB(returnFd);
 
     return -1;
   }
@@ -154,270 +667,434 @@ b_io_fd b_open(char *filename, int flags)
 
   if (found_index > -1)
   {
-    memcpy(fcbArray[returnFd].fi, &dirArray[found_index], sizeof(DirectoryEntry));
-    fcbArray[returnFd].fileIndex = found_index;
+    memcpy(fcbTable[returnFd]->fi, &entry, sizeof(DirectoryEntry));
   }
   else
   {
-    int new_index = get_avail_de_idx(dirArray);
-    if (new_index == -1)
+    // a new file starts inline in its inode, without blocks
+    memset(&entry, 0, sizeof(DirectoryEntry));
+    entry.size = 0;
+    entry.num_blocks = 0;
+    entry.location = 0;
+    time_t curr_time = time(NULL);
+    entry.timeCreated = curr_time;
+    entry.timeLastModified = curr_time;
+    entry.timeLastViewed = curr_time;
+    entry.attributes = 'f';
+    strcpy(entry.name, last_token);
+
+    if (alloc_inode(&entry) != 0)
     {
+      free(fcbTable[returnFd]->fi);
+      fcbTable[returnFd]->fi = NULL;
+      free(buf);
+      free(bufBlk);
+      releaseFCB(returnFd);
       return -1;
     }
 
-    int new_location = allocateBlock(DEFAULT_FILE_BLOCKS);
-    if (new_location == -1)
+    int new_index = insert_de(parent, &entry);
+    if (new_index == -1)
     {
+      free_inode(entry.inode);
+      free(fcbTable[returnFd]->fi);
+      fcbTable[returnFd]->fi = NULL;
+      free(buf);
+      free(bufBlk);
+      releaseFCB(returnFd);
       return -1;
     }
 
-    // New directory entry initialization
-    dirArray[new_index].size = 0;
-    dirArray[new_index].num_blocks = DEFAULT_FILE_BLOCKS;
-    dirArray[new_index].location = new_location;
-    time_t curr_time = time(NULL);
-    dirArray[new_index].timeCreated = curr_time;
-    dirArray[new_index].timeLastModified = curr_time;
-    dirArray[new_index].timeLastViewed = curr_time;
-    dirArray[new_index].attributes = 'f';
-    strcpy(dirArray[new_index].name, last_token);
-
     // write new empty file to disk
-    write_fs(dirArray);
+    write_fs();
+    dcacheInsert(parent, last_token, new_index, &entry);
 
-    // copy new directory entry to fcbArray file info
-    memcpy(fcbArray[returnFd].fi, &dirArray[new_index], sizeof(DirectoryEntry));
-
-    fcbArray[returnFd].fileIndex = new_index;
+    // copy new directory entry to the fcb file info
+    memcpy(fcbTable[returnFd]->fi, &entry, sizeof(DirectoryEntry));
   }
 
-  // initialize fcbArray entry
-  fcbArray[returnFd].dirArray = dirArray;
-  fcbArray[returnFd].buf = buf;
-  fcbArray[returnFd].index = 0;
-  fcbArray[returnFd].bufLen = 0;
-  fcbArray[returnFd].numBlocks = 0;
-  fcbArray[returnFd].currentBlk = fcbArray[returnFd].fi->location;
-  fcbArray[returnFd].accessMode = flags;
+  // initialize the fcb
+  fcbTable[returnFd]->buf = buf;
+  fcbTable[returnFd]->bufBlocks = bufBlocks;
+  fcbTable[returnFd]->bufCount = 0;
+  fcbTable[returnFd]->bufBlk = bufBlk;
+  fcbTable[returnFd]->bufPrev = -1;
+  fcbTable[returnFd]->index = 0;
+  fcbTable[returnFd]->bufLen = 0;
+  fcbTable[returnFd]->dirtyStart = 0;
+  fcbTable[returnFd]->dirtyEnd = 0;
+  fcbTable[returnFd]->numBlocks = 0;
+  fcbTable[returnFd]->currentBlk = fcbTable[returnFd]->fi->location;
+  fcbTable[returnFd]->prevBlk = -1;
+  fcbTable[returnFd]->accessMode = flags;
+  fcbTable[returnFd]->metaDirty = 0;
+  fcbTable[returnFd]->metaWritten = time(NULL);
+
+  // an inline file is held in the buffer whole
+  if (fcbTable[returnFd]->fi->num_blocks == 0)
+  {
+    if (read_inline_data(fcbTable[returnFd]->fi->inode, buf, fcbTable[returnFd]->fi->size) != 0)
+    {
+      free(fcbTable[returnFd]->fi);
+      fcbTable[returnFd]->fi = NULL;
+      free(buf);
+      free(bufBlk);
+      releaseFCB(returnFd);
+      return -1;
+    }
+    fcbTable[returnFd]->bufLen = fcbTable[returnFd]->fi->size;
+  }
 
   // Per man page requirements, O_TRUNC sets file size to zero;
   if (flags & O_TRUNC)
   {
-    fcbArray[returnFd].fi->size = 0;
+    fcbTable[returnFd]->fi->size = 0;
+    fcbTable[returnFd]->bufLen = 0;
+    fcbTable[returnFd]->metaDirty |= META_DATA;
   }
 
-  free(last_token);
-  last_token = NULL;
-
   return (returnFd);
 }
 
+// Interface to open a buffered file
+// Modification of interface for this assignment, flags match the Linux flags for open
+// O_RDONLY, O_WRONLY, or O_RDWR
+b_io_fd b_open(char *filename, int flags)
+{
+  return openAt(cw_dir_location, filename, flags);
+}
+
+// open a file relative to an open directory
+b_io_fd b_openat(fdDir *dirp, char *name, int flags)
+{
+  if (dirp == NULL)
+  {
+    return -1;
+  }
+  return openAt(dirp->directoryStartLocation, name, flags);
+}
+
 // Interface to seek function
 int b_seek(b_io_fd fd, off_t offset, int whence)
 {
-  if (startup == 0)
-    b_init(); // Initialize our system
-
-  // check that fd is between 0 and (MAXFCBS-1)
-  if ((fd < 0) || (fd >= MAXFCBS))
+  // check that fd is an open file
+  if (openFCB(fd) == NULL)
   {
     return (-1); // invalid file descriptor
   }
 
-  // Calculate block offset to retrieve the current block number
-  int block_offset = offset / myVCB->block_size;
+  // an inline file is all in the buffer, only the position moves
+  if (fcbTable[fd]->fi->num_blocks == 0)
+  {
+    off_t position = offset;
+    if (whence == SEEK_CUR)
+    {
+      position += fcbTable[fd]->index;
+    }
+    else if (whence == SEEK_END)
+    {
+      position += fcbTable[fd]->fi->size;
+    }
+
+    if (position < 0 || position > (off_t)fcbTable[fd]->fi->size)
+    {
+      return -1;
+    }
+    fcbTable[fd]->index = position;
+    fcbTable[fd]->fi->timeLastViewed = time(NULL);
+    fcbTable[fd]->metaDirty |= META_TIMES;
+    return fcbTable[fd]->index;
+  }
+
+  // the buffer is written out before the position leaves it
+  if (retireBuffer(fd) != 0)
+  {
+    return -1;
+  }
 
-  // Set absolute block offset
-  if (whence & SEEK_SET)
+  off_t position = offset;
+  if (whence == SEEK_CUR)
+  {
+    position += filePosition(fd);
+  }
+  else if (whence == SEEK_END)
   {
-    fcbArray[fd].currentBlk = get_block(fcbArray[fd].fi->location, block_offset);
+    position += fcbTable[fd]->fi->size;
   }
 
-  // set relative block offset
-  else if (whence & SEEK_CUR)
+  if (position < 0 || position > (off_t)fcbTable[fd]->fi->size)
   {
-    fcbArray[fd].currentBlk = get_block(fcbArray[fd].currentBlk, block_offset);
+    return -1;
   }
 
-  // set current block to the block following the end of file
-  else if (whence & SEEK_END)
+  // follow the chain on from where it is when moving forward, from the
+  // start of the file otherwise
+  int block = BLOCK_INDEX(position);
+  if (block < fcbTable[fd]->numBlocks)
   {
-    fcbArray[fd].currentBlk = get_block(fcbArray[fd].fi->location, fcbArray[fd].fi->num_blocks);
+    fcbTable[fd]->currentBlk = fcbTable[fd]->fi->location;
+    fcbTable[fd]->prevBlk = -1;
+    fcbTable[fd]->numBlocks = 0;
+  }
+  while (fcbTable[fd]->numBlocks < block)
+  {
+    nextBlock(fd);
+    fcbTable[fd]->numBlocks++;
   }
 
-  // set buffer offset to whatever remains after all the full blocks are
-  // accounted for.
-  fcbArray[fd].index = offset % myVCB->block_size;
-  fcbArray[fd].bufLen = 0;
-  fcbArray[fd].fi->timeLastViewed = time(NULL);
+  // the buffer is empty, the position is an offset into currentBlk
+  fcbTable[fd]->index = BLOCK_OFFSET(position);
+  fcbTable[fd]->fi->timeLastViewed = time(NULL);
+  fcbTable[fd]->metaDirty |= META_TIMES;
 
-  return fcbArray[fd].index; // Change this
+  return position;
 }
 
-// Interface to write function
-int b_write(b_io_fd fd, char *buffer, int count)
+// Interface to set the buffer size of an open file, size is in bytes
+// and rounded up to whole blocks
+int b_setvbuf(b_io_fd fd, int size)
 {
-  if (startup == 0)
-    b_init(); // Initialize our system
-
-  // check that fd is between 0 and (MAXFCBS-1)
-  if ((fd < 0) || (fd >= MAXFCBS) || count < 0)
+  // check that fd is an open file
+  if (openFCB(fd) == NULL || size <= 0)
   {
-    return (-1); // invalid file descriptor
+    return -1;
   }
 
-  // check to see if the fcb exists in this location
-  if (fcbArray[fd].fi == NULL)
+  // the old buffer is written out and emptied, an inline file keeps its
+  // bytes in it
+  if (retireBuffer(fd) != 0)
   {
     return -1;
   }
 
-  // calculate if extra blocks are necessary
-  int extra_blocks = get_num_blocks(
-      fcbArray[fd].fi->size + count + myVCB->block_size - (fcbArray[fd].fi->num_blocks * myVCB->block_size),
-      myVCB->block_size);
-
-  if (extra_blocks > 0)
+  int bufBlocks = bufferBlocks(size);
+  char *buf = malloc(BLOCKS_TO_BYTES(bufBlocks));
+  int64_t *bufBlk = malloc(bufBlocks * sizeof(int64_t));
+  if (buf == NULL || bufBlk == NULL)
   {
-    // set the number of extra blocks
-    extra_blocks = fcbArray[fd].fi->num_blocks > extra_blocks
-                       ? fcbArray[fd].fi->num_blocks
-                       : extra_blocks;
-
-    // allocate the free blocks and save location
-    int free_location = allocateBlock(extra_blocks);
-
-    if (free_location < 0)
-    {
-      perror("Freespace allocation failed\n\n");
-      return -1;
-    }
-
-    // set final block of file in the free space map to the starting block
-    bitmap[get_block(fcbArray[fd].fi->location, fcbArray[fd].fi->num_blocks - 1)] = free_location;
-    fcbArray[fd].fi->num_blocks += extra_blocks;
+    free(buf);
+    free(bufBlk);
+    return -1;
   }
 
-  int bytesDelivered = 0;
-  int avail_Bytes;
-  if (fcbArray[fd].fi->size < 1)
-  {
-    fcbArray[fd].fi->size = 0;
-    avail_Bytes = myVCB->block_size;
-  }
-  else
+  if (fcbTable[fd]->fi->num_blocks == 0)
   {
-    // available bytes in buffer
-    avail_Bytes = myVCB->block_size - fcbArray[fd].index;
+    memcpy(buf, fcbTable[fd]->buf, fcbTable[fd]->bufLen);
   }
 
-  /* split buffer into three parts. part1 is what is left in the buffer,
-   part2 is the section of the buffer that occupies zero to many entire blocks,
-   part3 is the remaining amount to partially fill the buffer. */
+  free(fcbTable[fd]->buf);
+  free(fcbTable[fd]->bufBlk);
+  fcbTable[fd]->buf = buf;
+  fcbTable[fd]->bufBlk = bufBlk;
+  fcbTable[fd]->bufBlocks = bufBlocks;
+  return 0;
+}
 
-  int part1, part2, part3, numBlocksToCopy, blocksWritten;
-  if (avail_Bytes >= count)
+// Interface to write function
+int b_write(b_io_fd fd, char *buffer, int count)
+{
+  // check that fd is an open file
+  if (openFCB(fd) == NULL || count < 0)
   {
-    part1 = count;
-    part2 = 0;
-    part3 = 0;
+    return (-1); // invalid file descriptor
   }
-  else
-  {
 
-    part1 = avail_Bytes;
+  STAT_INC(file_writes);
+
+  uint64_t position = filePosition(fd);
+  uint64_t end = position + count;
 
-    // set the part3 section to all the bytes left
-    part3 = count - avail_Bytes;
+  // a file that still fits its inode is written there, no blocks needed
+  if (fcbTable[fd]->fi->num_blocks == 0 && end <= INODE_INLINE_BYTES)
+  {
+    memcpy(fcbTable[fd]->buf + fcbTable[fd]->index, buffer, count);
+    fcbTable[fd]->index += count;
 
-    /*Divide Part3 by the chunk size to find the total blocks,
-    then multiply by the chunk size for Part2's byte size. */
-    numBlocksToCopy = part3 / myVCB->block_size;
-    part2 = numBlocksToCopy * myVCB->block_size;
+    time_t cur_time = time(NULL);
+    fcbTable[fd]->fi->timeLastViewed = cur_time;
+    fcbTable[fd]->fi->timeLastModified = cur_time;
+    if (end > fcbTable[fd]->fi->size)
+    {
+      fcbTable[fd]->fi->size = end;
+      fcbTable[fd]->bufLen = end;
+    }
+    STAT_ADD(file_bytes_written, count);
 
-    // Subtract the complete bytes to get the part3 bytes left
-    part3 = part3 - part2;
+    // the bytes stay in the buffer until the inode is written
+    fcbTable[fd]->metaDirty |= META_TIMES | META_DATA;
+    if (periodicFlush(fd) != 0)
+    {
+      return -1;
+    }
+    return count;
   }
 
-  // part1 section
-  if (part1 > 0)
+  // calculate if extra blocks are necessary
+  int64_t short_bytes = (int64_t)end - (int64_t)fcbTable[fd]->fi->num_blocks * myVCB->block_size;
+  int extra_blocks = short_bytes > 0 ? get_num_blocks(short_bytes, myVCB->block_size) : 0;
+
+  if (extra_blocks > 0)
   {
-    // copy part1 of the user's buffer into the fcb buffer
-    memcpy(fcbArray[fd].buf + fcbArray[fd].index, buffer, part1);
+    // set the number of extra blocks
+    extra_blocks = fcbTable[fd]->fi->num_blocks > extra_blocks
+                       ? fcbTable[fd]->fi->num_blocks
+                       : extra_blocks;
 
-    // write the entire block to disk
-    blocksWritten = LBAwrite(fcbArray[fd].buf, 1, fcbArray[fd].currentBlk);
+    // a file leaving its inode gets the default reservation, a byte
+    // count so large blocks do not reserve more space than small ones
+    if (fcbTable[fd]->fi->num_blocks == 0)
+    {
+      int file_blocks = get_num_blocks(DEFAULT_FILE_BLOCKS * MINBLOCKSIZE, myVCB->block_size);
+      extra_blocks = file_blocks > extra_blocks ? file_blocks : extra_blocks;
+    }
 
-    // set buffer offset
-    fcbArray[fd].index += part1;
+    // allocate the free blocks and save location
+    int64_t free_location = allocateBlock(extra_blocks);
 
-    // get the next block and reset the fcb buffer offset to zero.
-    if (fcbArray[fd].index >= myVCB->block_size)
+    if (free_location < 0)
     {
-      fcbArray[fd].currentBlk = get_next_block(fcbArray[fd].currentBlk);
-      fcbArray[fd].index = 0;
+      perror("Freespace allocation failed\n\n");
+      return -1;
     }
-  }
 
-  if (part2 > 0)
-  {
-    blocksWritten = 0;
+    int promoted = fcbTable[fd]->fi->num_blocks == 0;
+    if (promoted)
+    {
+      fcbTable[fd]->fi->location = free_location;
+      fcbTable[fd]->currentBlk = free_location;
+      fcbTable[fd]->prevBlk = -1;
+      STAT_INC(file_promotions);
+    }
+    else
+    {
+      // the final block gets a new link, a shared chain is made the
+      // file's own first
+      int64_t last = get_block(fcbTable[fd]->fi->location, fcbTable[fd]->fi->num_blocks - 1);
+      if (block_shared(last) != 0)
+      {
+        if (privatizeThrough(fd, last) != 0)
+        {
+          return -1;
+        }
+        remapBuffer(fd);
+        last = get_block(fcbTable[fd]->fi->location, fcbTable[fd]->fi->num_blocks - 1);
+      }
+
+      // set final block of file in the free space map to the starting block
+      set_next_block(last, free_location);
+
+      // a position at the old end of the chain now has a block
+      if (fcbTable[fd]->currentBlk == END_OF_CHAIN)
+      {
+        fcbTable[fd]->currentBlk = free_location;
+      }
+    }
+    fcbTable[fd]->fi->num_blocks += extra_blocks;
+    fcbTable[fd]->metaDirty |= META_BLOCKS;
 
-    for (int i = 0; i < numBlocksToCopy; i++)
+    // the buffer holds the inline data, it goes to the first block
+    if (promoted)
     {
-      blocksWritten += LBAwrite(buffer + part1 + (i * myVCB->block_size), 1, fcbArray[fd].currentBlk);
-      fcbArray[fd].currentBlk = get_next_block(fcbArray[fd].currentBlk);
+      mapBuffer(fd, fcbTable[fd]->bufBlocks);
+      if (fcbTable[fd]->fi->size > 0)
+      {
+        markDirty(fd, 0, fcbTable[fd]->fi->size);
+      }
     }
-    part2 = blocksWritten * myVCB->block_size; // number of bytes written
   }
 
-  if (part3 > 0)
+  /* the user's bytes go into the buffer, which is written out when the
+   position moves past it. A write of a whole buffer or more starting on
+   a block boundary skips the buffer and goes to disk in runs. */
+
+  int bytesWritten = 0;
+  while (bytesWritten < count)
   {
-    // copy the user buffer into the fcb buffer
-    memcpy(fcbArray[fd].buf + fcbArray[fd].index, buffer + part1 + part2, part3);
+    int left = count - bytesWritten;
+    if (fcbTable[fd]->bufCount == 0 && fcbTable[fd]->index == 0 &&
+        (uint64_t)left >= BLOCKS_TO_BYTES(fcbTable[fd]->bufBlocks))
+    {
+      int blocks = mapBuffer(fd, fcbTable[fd]->bufBlocks);
+      if (blocks == 0)
+      {
+        break;
+      }
+
+      int status = writeRuns(fd, buffer + bytesWritten, 0, blocks - 1);
+      fcbTable[fd]->bufCount = 0;
+      if (status != 0)
+      {
+        return -1;
+      }
+      bytesWritten += BLOCKS_TO_BYTES(blocks);
+      continue;
+    }
 
-    // write entire block to disk
-    blocksWritten = LBAwrite(fcbArray[fd].buf, 1, fcbArray[fd].currentBlk);
+    // a new buffer is filled first so a partly written block keeps the
+    // rest of its bytes. Blocks allocated since extend the buffer.
+    int fresh = fcbTable[fd]->bufCount == 0;
+    mapBuffer(fd, fcbTable[fd]->bufBlocks);
+    if (fresh && loadBuffer(fd) != 0)
+    {
+      return -1;
+    }
 
-    fcbArray[fd].index += part3;
-  }
+    int room = BLOCKS_TO_BYTES(fcbTable[fd]->bufCount) - fcbTable[fd]->index;
+    if (room <= 0)
+    {
+      // a full buffer is written out, an empty one means no blocks left
+      if (fcbTable[fd]->bufCount == 0 || retireBuffer(fd) != 0)
+      {
+        break;
+      }
+      continue;
+    }
 
-  // if the fcb buffer is full, get the next block and set the offset to zero
-  if (fcbArray[fd].index >= myVCB->block_size)
-  {
-    fcbArray[fd].currentBlk = get_next_block(fcbArray[fd].currentBlk);
-    fcbArray[fd].index = 0;
+    int part = left < room ? left : room;
+    memcpy(fcbTable[fd]->buf + fcbTable[fd]->index, buffer + bytesWritten, part);
+    markDirty(fd, fcbTable[fd]->index, fcbTable[fd]->index + part);
+    fcbTable[fd]->index += part;
+    if (fcbTable[fd]->index > fcbTable[fd]->bufLen)
+    {
+      fcbTable[fd]->bufLen = fcbTable[fd]->index;
+    }
+    bytesWritten += part;
   }
 
   // set accessed/modified times and file size
   time_t cur_time = time(NULL);
-  fcbArray[fd].fi->timeLastViewed = cur_time;
-  fcbArray[fd].fi->timeLastModified = cur_time;
-  bytesDelivered = part1 + part2 + part3;
-  fcbArray[fd].fi->size += bytesDelivered;
-
-  // copy changes to the fcb directory entry
-  memcpy(&fcbArray[fd].dirArray[fcbArray[fd].fileIndex], fcbArray[fd].fi, sizeof(DirectoryEntry));
+  fcbTable[fd]->fi->timeLastViewed = cur_time;
+  fcbTable[fd]->fi->timeLastModified = cur_time;
+  if (position + bytesWritten > fcbTable[fd]->fi->size)
+  {
+    fcbTable[fd]->fi->size = position + bytesWritten;
+  }
+  STAT_ADD(file_bytes_written, bytesWritten);
+  fcbTable[fd]->metaDirty |= META_TIMES | META_DATA;
 
-  // write changes to disk
-  write_dircetory(fcbArray[fd].dirArray);
+  // new blocks are linked in the map now, so the inode goes with them.
+  // The size and times wait for periodicFlush, b_close or a sync.
+  if (flushMeta(fd, META_BLOCKS) != 0 || periodicFlush(fd) != 0)
+  {
+    return -1;
+  }
 
-  return part1 + part2 + part3;
+  return bytesWritten;
 }
 
 // Interface to read a buffer
 
 // Filling the callers request is broken into three parts
 // Part 1 is what can be filled from the current buffer, which may or may not be enough
-// Part 2 is after using what was left in our buffer there is still 1 or more block
-//        size chunks needed to fill the callers request.  This represents the number of
-//        bytes in multiples of the blocksize.
-// Part 3 is a value less than blocksize which is what remains to copy to the callers buffer
-//        after fulfilling part 1 and part 2.  This would always be filled from a refill
-//        of our buffer.
+// Part 2 is after using what was left in our buffer there is still 1 or more buffer
+//        size chunks needed to fill the callers request.  These are read straight into
+//        the caller's buffer, one LBAread for each run of adjacent blocks.
+// Part 3 is a value less than the buffer size which is what remains to copy to the
+//        callers buffer after fulfilling part 1 and part 2.  This would always be
+//        filled from a refill of our buffer, which reads the next blocks of the chain.
 //  +-------------+------------------------------------------------+--------+
 //  |             |                                                |        |
-//  | filled from |  filled direct in multiples of the block size  | filled |
+//  | filled from |  filled direct in multiples of the buffer size | filled |
 //  | existing    |                                                | from   |
 //  | buffer      |                                                |refilled|
 //  |             |                                                | buffer |
@@ -427,135 +1104,106 @@ int b_write(b_io_fd fd, char *buffer, int count)
 
 int b_read(b_io_fd fd, char *buffer, int count)
 {
-  if (startup == 0)
-    b_init(); // Initialize our system
-
-  // check that fd is between 0 and (MAXFCBS-1)
-  if ((fd < 0) || (fd >= MAXFCBS))
+  // check that fd is an open file
+  if (openFCB(fd) == NULL)
   {
     return -1; // invalid file descriptor
   }
 
-  if (fcbArray[fd].accessMode & O_WRONLY)
+  if (fcbTable[fd]->accessMode & O_WRONLY)
   {
     perror("b_read: file does not have read access");
     return -1;
   }
 
-  // check to see if the fcb exists
-  if (fcbArray[fd].fi == NULL)
-  {
-    return -1;
-  }
-
-  int totalBytesRead = fcbArray[fd].numBlocks * myVCB->block_size + fcbArray[fd].index + 1;
+  STAT_INC(file_reads);
 
-  if (totalBytesRead >= fcbArray[fd].fi->size)
+  // end of file
+  uint64_t position = filePosition(fd);
+  if (position >= fcbTable[fd]->fi->size)
   {
-    return -1;
+    return 0;
   }
 
-  // available bytes in buffer
-  int avail_Bytes;
-
-  avail_Bytes = fcbArray[fd].bufLen - fcbArray[fd].index;
-
-  // number of bytes already delivered
-  int bytesDelivered = (fcbArray[fd].numBlocks * myVCB->block_size) - avail_Bytes;
-
   // limit count to file length
-  if ((count + bytesDelivered) > fcbArray[fd].fi->size)
-  {
-    count = fcbArray[fd].fi->size - bytesDelivered;
-  }
-
-  int part1, part2, part3, numBlocksToCopy, blocksRead;
-  if (avail_Bytes >= count)
-  {
-
-    part1 = count;
-    part2 = 0;
-    part3 = 0;
-  }
-  else
-  {
-    part1 = avail_Bytes;
-
-    // set the part3 section to what is left
-    part3 = count - avail_Bytes;
-
-    /*Divide Part3 by the chunk size to find the total blocks,
-    then multiply by the chunk size for Part2's byte size. */
-    numBlocksToCopy = part3 / myVCB->block_size;
-    part2 = numBlocksToCopy * myVCB->block_size;
-
-    // update the part3 bytes left
-    part3 = part3 - part2;
-  }
-
-  // memcopy part1 section
-  if (part1 > 0)
+  if (count > fcbTable[fd]->fi->size - position)
   {
-    memcpy(buffer, fcbArray[fd].buf + fcbArray[fd].index, part1);
-
-    fcbArray[fd].index += part1;
+    count = fcbTable[fd]->fi->size - position;
   }
 
-  // LBAread all the complete blocks into the buffer
-  if (part2 > 0)
+  int bytesRead = 0;
+  while (bytesRead < count)
   {
-    blocksRead = 0;
+    int left = count - bytesRead;
 
-    // read each block one-by-one since we don't know where the next block will be
-    for (int i = 0; i < numBlocksToCopy; i++)
+    // part1 and part3, from the buffer
+    int avail_Bytes = fcbTable[fd]->bufLen - fcbTable[fd]->index;
+    if (avail_Bytes > 0)
     {
-      blocksRead += LBAread(buffer + part1 + (i * myVCB->block_size), 1, fcbArray[fd].currentBlk);
-      fcbArray[fd].currentBlk = get_next_block(fcbArray[fd].currentBlk);
+      int part = left < avail_Bytes ? left : avail_Bytes;
+      memcpy(buffer + bytesRead, fcbTable[fd]->buf + fcbTable[fd]->index, part);
+      fcbTable[fd]->index += part;
+      bytesRead += part;
+      continue;
     }
-    fcbArray[fd].numBlocks += blocksRead;
-    part2 = blocksRead * myVCB->block_size;
-  }
 
-  // LBAread remaining block into the fcb buffer, and reset buffer offset
-  if (part3 > 0)
-  {
-    blocksRead = LBAread(fcbArray[fd].buf, 1, fcbArray[fd].currentBlk);
-    fcbArray[fd].bufLen = myVCB->block_size;
+    if (retireBuffer(fd) != 0)
+    {
+      break;
+    }
 
-    fcbArray[fd].currentBlk = get_next_block(fcbArray[fd].currentBlk);
-    fcbArray[fd].numBlocks += 1;
-    fcbArray[fd].index = 0;
+    // part2, whole buffers straight into the caller's buffer
+    if (fcbTable[fd]->index == 0 && (uint64_t)left >= BLOCKS_TO_BYTES(fcbTable[fd]->bufBlocks))
+    {
+      int blocks = mapBuffer(fd, fcbTable[fd]->bufBlocks);
+      fcbTable[fd]->bufCount = 0;
+      if (blocks == 0 || readRuns(fd, buffer + bytesRead, 0, blocks - 1) != 0)
+      {
+        break;
+      }
+      bytesRead += BLOCKS_TO_BYTES(blocks);
+      continue;
+    }
 
-    // if the number of bytes is more than zero, copy the fd buffer to the buffer
-    if (part3 > 0)
+    // refill the buffer with the next blocks of the chain
+    mapBuffer(fd, fcbTable[fd]->bufBlocks);
+    if (loadBuffer(fd) != 0 || fcbTable[fd]->bufLen <= fcbTable[fd]->index)
     {
-      memcpy(buffer + part1 + part2, fcbArray[fd].buf + fcbArray[fd].index, part3);
-      fcbArray[fd].index += part3;
+      break;
     }
   }
 
-  fcbArray[fd].fi->timeLastViewed = time(NULL);
+  fcbTable[fd]->fi->timeLastViewed = time(NULL);
+  fcbTable[fd]->metaDirty |= META_TIMES;
+  STAT_ADD(file_bytes_read, bytesRead);
 
-  return part1 + part2 + part3;
+  return bytesRead;
 }
 
 // interface to move files or directories
 int b_move(char *dest, char *src)
 {
+  ParsedPath src_path;
+  ParsedPath dest_path;
+  if (parsePath(src, &src_path) != 0 || parsePath(dest, &dest_path) != 0)
+  {
+    return -1;
+  }
 
-  DirectoryEntry *src_d_arr = parsePath(src);
-  char *src_token = get_last_token(src);
-  int src_index = get_de_index(src_token, src_d_arr);
+  long src_parent = resolveParent(&src_path);
+  const char *src_token = pathLast(&src_path);
+  DirectoryEntry entry;
+  int src_index = src_parent == -1 ? -1 : get_de_index(src_parent, src_token, &entry);
 
-  if (src_index < 0)
+  if (src_index < DE_FIRST_SLOT)
   {
     perror("file or directory not found");
     return -1;
   }
 
-  DirectoryEntry *dir_path = parsePath(dest);
-  char *dest_tok = get_last_token(dest);
-  int dest_index = get_de_index(dest_tok, dir_path);
+  long dest_parent = resolveParent(&dest_path);
+  const char *dest_tok = pathLast(&dest_path);
+  int dest_index = dest_parent == -1 ? 0 : get_de_index(dest_parent, dest_tok, NULL);
 
   if (dest_index > -1)
   {
@@ -563,73 +1211,216 @@ int b_move(char *dest, char *src)
     return -1;
   }
 
-  if (dir_path[0].location == src_d_arr[0].location)
+  // add the entry under its new name, then drop the old one. Both
+  // records point at the same inode, so the metadata stays where it is
+  strcpy(entry.name, dest_tok);
+  dest_index = insert_de(dest_parent, &entry);
+
+  if (dest_index < 0)
   {
-    strcpy(src_d_arr[src_index].name, dest_tok);
-    write_dircetory(src_d_arr);
+    return -1;
+  }
 
-    free(src_d_arr);
-    src_d_arr = NULL;
-    free(src_token);
-    src_token = NULL;
+  // the source name no longer resolves to this entry
+  dcacheRemove(src_parent, src_token);
+  remove_de(src_parent, src_token);
 
-    free(dir_path);
-    dir_path = NULL;
-    free(dest_tok);
-    dest_tok = NULL;
+  // the destination may have grown
+  write_fs();
+  dcacheInsert(dest_parent, dest_tok, dest_index, &entry);
 
-    return 0;
+  // a directory moved elsewhere gets its ".." pointed at the new parent
+  if (entry.attributes == 'd' && dest_parent != src_parent)
+  {
+    set_de_parent(entry.location, dest_parent);
+    dcachePurgeDir(entry.location);
   }
 
-  // get an available directory entry
-  dest_index = get_avail_de_idx(dir_path);
+  // the current working path may run through a moved directory
+  if (entry.attributes == 'd')
+  {
+    cwdMoved(entry.location, src_parent, dest_parent, dest_tok);
+  }
 
-  if (dest_index < 0)
+  return 0;
+}
+
+// interface to clone a file, dest shares the blocks of src until one of
+// them writes to a block
+int b_clone(char *dest, char *src)
+{
+  ParsedPath src_path;
+  ParsedPath dest_path;
+  if (parsePath(src, &src_path) != 0 || parsePath(dest, &dest_path) != 0)
+  {
+    return -1;
+  }
+
+  long src_parent = resolveParent(&src_path);
+  const char *src_token = pathLast(&src_path);
+  DirectoryEntry entry;
+  int src_index = src_parent == -1 ? -1 : get_de_index(src_parent, src_token, &entry);
+
+  if (src_index < DE_FIRST_SLOT || entry.attributes != 'f')
+  {
+    perror("b_clone: source is not a file");
+    return -1;
+  }
+
+  long dest_parent = resolveParent(&dest_path);
+  const char *dest_tok = pathLast(&dest_path);
+  DirectoryEntry old;
+  int dest_index = dest_parent == -1 ? -1 : get_de_index(dest_parent, dest_tok, &old);
+
+  // an existing file other than src is replaced, nothing else may be
+  if (dest_parent == -1 || (dest_index > -1 && (dest_index < DE_FIRST_SLOT ||
+                                                old.attributes != 'f' ||
+                                                old.inode == entry.inode)))
   {
+    perror("b_clone: destination is not a file or its directory does not exist");
     return -1;
   }
 
-  // copy the source directory entry to the destination directory entry
-  memcpy(&dir_path[dest_index], &src_d_arr[src_index], sizeof(DirectoryEntry));
+  DirectoryEntry clone = entry;
+  time_t now = time(NULL);
+  clone.timeCreated = now;
+  clone.timeLastModified = now;
+  clone.timeLastViewed = now;
+  strcpy(clone.name, dest_tok);
 
-  // Change the destination name, then write the changes to disk
-  strcpy(dir_path[dest_index].name, dest_tok);
-  write_dircetory(dir_path);
+  // an inline file has no blocks to share, its data is copied
+  char data[INODE_INLINE_BYTES];
+  if (clone.num_blocks == 0 && read_inline_data(entry.inode, data, entry.size) != 0)
+  {
+    return -1;
+  }
+
+  // only the counts of the blocks change, no data is copied
+  if (clone.num_blocks > 0 && share_chain(clone.location, clone.num_blocks) != 0)
+  {
+    return -1;
+  }
 
-  // reset the source directory entry
-  src_d_arr[src_index].name[0] = '\0';
-  src_d_arr[src_index].attributes = 'a';
-  write_dircetory(src_d_arr);
+  if (dest_index > -1)
+  {
+    // the clone takes over the inode of the file it replaces, so dest
+    // names the old file until the inode is written and the copy after.
+    // The old blocks lose their holder only once nothing points at them
+    clone.inode = old.inode;
+    if (write_inode(&clone) != 0 ||
+        (clone.num_blocks == 0 && write_inline_data(clone.inode, data, entry.size) != 0))
+    {
+      if (clone.num_blocks > 0)
+      {
+        release_chain(clone.location, clone.num_blocks);
+      }
+      return -1;
+    }
+    if (old.num_blocks > 0)
+    {
+      release_chain(old.location, old.num_blocks);
+    }
+    dcacheRemove(dest_parent, dest_tok);
+  }
+  else
+  {
+    if (alloc_inode(&clone) != 0)
+    {
+      if (clone.num_blocks > 0)
+      {
+        release_chain(clone.location, clone.num_blocks);
+      }
+      return -1;
+    }
 
-  free(src_d_arr);
-  src_d_arr = NULL;
-  free(src_token);
-  src_token = NULL;
+    if (clone.num_blocks == 0 && write_inline_data(clone.inode, data, entry.size) != 0)
+    {
+      free_inode(clone.inode);
+      return -1;
+    }
 
-  free(dir_path);
-  dir_path = NULL;
-  free(dest_tok);
-  dest_tok = NULL;
+    dest_index = insert_de(dest_parent, &clone);
+    if (dest_index < 0)
+    {
+      free_inode(clone.inode);
+      if (clone.num_blocks > 0)
+      {
+        release_chain(clone.location, clone.num_blocks);
+      }
+      return -1;
+    }
+  }
 
+  write_fs();
+  dcacheInsert(dest_parent, dest_tok, dest_index, &clone);
+  STAT_INC(file_clones);
   return 0;
 }
 
+// Write the buffer and the held inode changes named by mask, then commit
+// the journal so they survive a crash
+static int syncFile(b_io_fd fd, int mask)
+{
+  // check that fd is an open file
+  if (openFCB(fd) == NULL)
+  {
+    return -1;
+  }
+
+  STAT_INC(file_syncs);
+  if (fcbTable[fd]->fi->num_blocks > 0 && drainBuffer(fd) != 0)
+  {
+    return -1;
+  }
+
+  if (flushMeta(fd, mask) != 0)
+  {
+    return -1;
+  }
+  write_fs();
+  return journalCommit();
+}
+
+// Interface to flush a file's data and metadata to disk
+int b_fsync(b_io_fd fd)
+{
+  return syncFile(fd, META_TIMES | META_DATA | META_BLOCKS);
+}
+
+// Interface to flush a file's data and the metadata needed to read it
+// back, a change to the timestamps alone is left held
+int b_fdatasync(b_io_fd fd)
+{
+  return syncFile(fd, META_DATA | META_BLOCKS);
+}
+
 // Interface to Close the file
 int b_close(b_io_fd fd)
 {
-  // write any changesto disk
-  if (!(fcbArray[fd].accessMode & O_RDONLY) && fcbArray[fd].index > 0)
-    LBAwrite(fcbArray[fd].buf, 1, fcbArray[fd].currentBlk);
+  // check that fd is an open file
+  if (openFCB(fd) == NULL)
+  {
+    return -1; // invalid file descriptor
+  }
+
+  STAT_INC(file_closes);
+
+  // write what is left in the buffer, an inline file's bytes go with
+  // its inode
+  int status = 0;
+  if (fcbTable[fd]->fi->num_blocks > 0)
+    status = drainBuffer(fd);
 
-  // copy changes to the fcb directory entry
-  memcpy(&fcbArray[fd].dirArray[fcbArray[fd].fileIndex], fcbArray[fd].fi, sizeof(DirectoryEntry));
+  // write the inode if it changed, and the free space changes
+  if (flushMeta(fd, META_TIMES | META_DATA | META_BLOCKS) != 0)
+    status = -1;
 
-  write_fs(fcbArray[fd].dirArray);
+  write_fs();
 
-  free(fcbArray[fd].dirArray);
-  fcbArray[fd].dirArray = NULL;
-  free(fcbArray[fd].fi);
-  fcbArray[fd].fi = NULL;
-  free(fcbArray[fd].buf);
-  fcbArray[fd].buf = NULL;
+  // the descriptor is free even if a write failed
+  free(fcbTable[fd]->fi);
+  free(fcbTable[fd]->bufBlk);
+  free(fcbTable[fd]->buf);
+  releaseFCB(fd);
+  return status;
 }
@@ -17,12 +17,42 @@
 
 typedef int b_io_fd;
 
+#define B_DEFAULT_BUFFER (16 * 1024)       // buffer of a file opened normally
+#define B_LARGE_BUFFER (256 * 1024)        // buffer of a file opened with O_LARGEBUF
+#define B_MAX_BUFFER (16 * 1024 * 1024)    // largest buffer b_setvbuf gives
+
+// Most seconds a written file's size and times are held in its FCB
+// before b_write writes its inode
+#define B_META_SECONDS 5
+
+// Most files open at once, b_open fails with errno EMFILE beyond it
+#define B_MAX_OPEN_FILES 65536
+
+// b_open flag for a file read or written in long sequential runs, it
+// gets a B_LARGE_BUFFER buffer. Not one of the Linux flags.
+#define O_LARGEBUF 0x10000000
+
 b_io_fd b_open (char * filename, int flags);
 int b_read (b_io_fd fd, char * buffer, int count);
 int b_write (b_io_fd fd, char * buffer, int count);
 int b_seek (b_io_fd fd, off_t offset, int whence);
 int b_close (b_io_fd fd);
 
+// Sets the buffer of an open file to size bytes, rounded up to whole
+// blocks. Reads and writes move whole buffers between the file and the
+// disk, writes stay in the buffer until it is written out.
+int b_setvbuf (b_io_fd fd, int size);
+
+// Writes what is held for an open file and commits it. b_fsync includes
+// the timestamps, b_fdatasync only what reading the data back needs.
+int b_fsync (b_io_fd fd);
+int b_fdatasync (b_io_fd fd);
+
 int b_move (char *dest, char *src);
 
+// Makes dest a copy of the file src that shares its blocks. A block is
+// copied only when one of the two files writes to it. An existing file
+// dest is replaced, it names the old file until the copy is in place.
+int b_clone (char *dest, char *src);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,165 @@
+/**************************************************************
+ * Class::  CSC-415-02 Spring 2024
+ * Name:: Thiha Aung, Min Ye Thway Khaing, Dylan Nguyen
+ * GitHub-Name:: thihaaung32
+ * Group-Name:: Bee
+ * Project:: Basic File System
+ *
+ * File:: blockRef.c
+ *
+ * Description:: Block reference counts. A chain is worked through in
+ *            runs of consecutive blocks, so the counts of a run are
+ *            read and written with one call each.
+ *
+ **************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "blockRef.h"
+#include "freeSpaceManagement.h"
+#include "memo.h"
+#include "fsStats.h"
+
+int initBlockRefs()
+{
+  uint64_t blocks = get_num_blocks(myVCB->blockTotal * sizeof(BlockRef), myVCB->block_size);
+  int64_t location = allocateBlock(blocks);
+
+  // a zeroed count is a block no one else holds
+  if (location == -1 || clear_blocks(location, blocks) != 0)
+  {
+    perror("Failed to write the block reference counts");
+    return -1;
+  }
+
+  myVCB->blockRefLocation = location;
+  myVCB->blockRefBlocks = blocks;
+  return 0;
+}
+
+// Adds delta to the counts of count consecutive blocks from first. A
+// delta of 0 only checks every count has room for one more. With a delta
+// of -1 a block counting 0 had no other holder, so it goes back on the
+// free chain instead.
+static int adjustRun(uint64_t first, uint32_t count, int delta)
+{
+  BlockRef refs[BLOCK_REF_BATCH];
+  unsigned char last[BLOCK_REF_BATCH];
+  uint64_t offset = first * sizeof(BlockRef);
+  uint64_t length = count * sizeof(BlockRef);
+
+  if (cacheReadBytes(refs, myVCB->blockRefLocation, offset, length) != 0)
+  {
+    return -1;
+  }
+
+  for (uint32_t i = 0; i < count; i++)
+  {
+    if (delta == 0 && refs[i] == BLOCK_REF_MAX)
+    {
+      printf("Block %lu is shared too many times\n", first + i);
+      return -1;
+    }
+    last[i] = delta < 0 && refs[i] == 0;
+    if (delta > 0)
+    {
+      refs[i]++;
+    }
+    else if (delta < 0 && refs[i] > 0)
+    {
+      refs[i]--;
+    }
+  }
+
+  if (delta == 0)
+  {
+    return 0;
+  }
+  if (cacheWriteBytes(refs, myVCB->blockRefLocation, offset, length) != 0)
+  {
+    return -1;
+  }
+
+  // the blocks whose last holder let go are freed a run at a time
+  uint32_t i = 0;
+  while (i < count)
+  {
+    uint32_t start = i;
+    while (i < count && last[i])
+    {
+      i++;
+    }
+    if (i > start)
+    {
+      if (release_blocks(first + start, i - start) != 0)
+      {
+        return -1;
+      }
+      STAT_ADD(blocks_freed, i - start);
+    }
+    else
+    {
+      i++;
+    }
+  }
+  return 0;
+}
+
+// Applies adjustRun to the first blocks blocks of a chain
+static int adjustChain(uint64_t location, uint32_t blocks, int delta)
+{
+  long block = location;
+  uint32_t done = 0;
+
+  while (done < blocks && block != END_OF_CHAIN)
+  {
+    uint64_t first = block;
+    uint32_t run = 1;
+    block = get_next_block(block);
+    while (done + run < blocks && run < BLOCK_REF_BATCH && block == (long)(first + run))
+    {
+      run++;
+      block = get_next_block(block);
+    }
+
+    if (adjustRun(first, run, delta) != 0)
+    {
+      return -1;
+    }
+    done += run;
+  }
+  return 0;
+}
+
+int block_shared(uint64_t block)
+{
+  BlockRef ref;
+  if (cacheReadBytes(&ref, myVCB->blockRefLocation, block * sizeof(BlockRef),
+                     sizeof(BlockRef)) != 0)
+  {
+    return -1;
+  }
+  return ref > 0;
+}
+
+int share_chain(uint64_t location, uint32_t blocks)
+{
+  // nothing is counted unless every block has room
+  if (adjustChain(location, blocks, 0) != 0)
+  {
+    return -1;
+  }
+  STAT_ADD(blocks_shared, blocks);
+  return adjustChain(location, blocks, 1);
+}
+
+int unshare_block(uint64_t block)
+{
+  return adjustRun(block, 1, -1);
+}
+
+int release_chain(uint64_t location, uint32_t blocks)
+{
+  return adjustChain(location, blocks, -1);
+}
@@ -0,0 +1,51 @@
+/**************************************************************
+ * Class::  CSC-415-02 Spring 2024
+ * Name:: Thiha Aung, Min Ye Thway Khaing, Dylan Nguyen
+ * GitHub-Name:: thihaaung32
+ * Group-Name:: Bee
+ * Project:: Basic File System
+ *
+ * File:: blockRef.h
+ *
+ * Description:: Interface of the block reference counts. A clone
+ *            shares the blocks of its source instead of copying
+ *            them, and every block keeps a count of the other files
+ *            holding it. A file writing a shared block first copies
+ *            it to a block of its own.
+ *
+ *	The counts are one BlockRef per volume block in a region
+ *	allocated when the volume is formatted. They go through the
+ *	buffer cache like inodes, so the journal covers them. A block
+ *	no one else holds counts 0, which a new volume starts with.
+ *
+ **************************************************************/
+
+#ifndef _BLOCK_REF_H
+#define _BLOCK_REF_H
+
+#include <stdint.h>
+#include "structure.h"
+
+#define BLOCK_REF_MAX 0xFFFF  // most other files a block can be shared with
+#define BLOCK_REF_BATCH 256   // counts of a run read and written together
+
+typedef uint16_t BlockRef;
+
+// allocates and clears the counts of a new volume, 0 on success
+int initBlockRefs();
+
+// 1 if another file holds block too, 0 if not, -1 on error
+int block_shared(uint64_t block);
+
+// count one more holder for the first blocks blocks of the chain at
+// location, 0 on success or -1 if a block is shared too many times
+int share_chain(uint64_t location, uint32_t blocks);
+
+// a file stopped holding block, it copied it or went away
+int unshare_block(uint64_t block);
+
+// a file holding the chain went away, its shared blocks lose a holder
+// and the blocks it held alone go back on the free chain
+int release_chain(uint64_t location, uint32_t blocks);
+
+#endif
@@ -0,0 +1,339 @@
+/**************************************************************
+ * Class::  CSC-415-02 Spring 2024
+ * Name:: Thiha Aung, Min Ye Thway Khaing, Dylan Nguyen
+ * GitHub-Name:: thihaaung32
+ * Group-Name:: Bee
+ * Project:: Basic File System
+ *
+ * File:: dentryCache.c
+ *
+ * Description:: Dentry cache operations. Dentries live in a fixed
+ *            pool, are found through a hash table and are replaced
+ *            with the clock algorithm when the pool is full. Names
+ *            are interned in an arena, so dentries compare them by
+ *            pointer and a name that was never interned is a miss
+ *            without walking any chain of dentries.
+ *
+ **************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "dentryCache.h"
+#include "pathParse.h"
+#include "fsStats.h"
+
+#define DCACHE_BUCKETS 4096 // must be a power of two
+
+Dentry *dentries = NULL;
+int *dentryHeads = NULL;     // first dentry of each hash chain, -1 if empty
+char *dentryReferenced = NULL; // second chance bits for the clock
+int dentryFree = -1;         // free dentries are chained through next
+int dentryClock = 0;
+
+// An interned name in the arena, its characters follow it
+typedef struct
+{
+  int next;          // arena offset of the next name in the chain, -1 at the end
+  unsigned int hash; // nameHash of the name
+} InternedName;
+
+char *internArena = NULL;
+int *internHeads = NULL; // arena offset of the first name of each chain, -1 if empty
+int internUsed = 0;      // bytes of the arena handed out
+
+// hash of a name (FNV-1a)
+static unsigned int nameHash(const char *name)
+{
+  unsigned int hash = 2166136261u;
+
+  while (*name != '\0')
+  {
+    hash = (hash ^ (unsigned char)*name++) * 16777619u;
+  }
+  return hash;
+}
+
+// hash of a name within a directory, the name's hash mixed with the parent
+static unsigned int dentryHash(uint64_t parent, unsigned int hash)
+{
+  for (int i = 0; i < 8; i++)
+  {
+    hash = (hash ^ ((parent >> (i * 8)) & 0xff)) * 16777619u;
+  }
+  return hash;
+}
+
+// the interned copy of a name, NULL if it was never interned
+static const char *internFind(const char *name, unsigned int hash)
+{
+  int offset = internHeads[hash & (DCACHE_BUCKETS - 1)];
+
+  while (offset != -1)
+  {
+    InternedName *interned = (InternedName *)(internArena + offset);
+    const char *chars = (const char *)(interned + 1);
+
+    if (interned->hash == hash && strcmp(chars, name) == 0)
+    {
+      return chars;
+    }
+    offset = interned->next;
+  }
+  return NULL;
+}
+
+// forget every dentry and interned name
+static void dcacheReset()
+{
+  for (int i = 0; i < DCACHE_BUCKETS; i++)
+  {
+    dentryHeads[i] = -1;
+    internHeads[i] = -1;
+  }
+
+  // every dentry starts out on the free list
+  for (int i = 0; i < DCACHE_ENTRIES; i++)
+  {
+    dentries[i].next = i + 1 < DCACHE_ENTRIES ? i + 1 : -1;
+    dentries[i].name = NULL;
+    dentryReferenced[i] = 0;
+  }
+  dentryFree = 0;
+  dentryClock = 0;
+  internUsed = 0;
+}
+
+// the interned copy of a name, added to the arena if needed. A full
+// arena is only emptied together with the dentries pointing into it
+static const char *intern(const char *name, unsigned int hash)
+{
+  const char *chars = internFind(name, hash);
+  if (chars != NULL)
+  {
+    return chars;
+  }
+
+  // keep every InternedName aligned
+  int size = sizeof(InternedName) + strlen(name) + 1;
+  size = (size + sizeof(int) - 1) & ~(int)(sizeof(int) - 1);
+
+  if (internUsed + size > DCACHE_ARENA_BYTES)
+  {
+    dcacheReset();
+    STAT_INC(dcache_resets);
+  }
+
+  InternedName *interned = (InternedName *)(internArena + internUsed);
+  int bucket = hash & (DCACHE_BUCKETS - 1);
+  interned->hash = hash;
+  interned->next = internHeads[bucket];
+  internHeads[bucket] = internUsed;
+  internUsed += size;
+
+  strcpy((char *)(interned + 1), name);
+  return (const char *)(interned + 1);
+}
+
+int initDentryCache()
+{
+  dentries = malloc(DCACHE_ENTRIES * sizeof(Dentry));
+  dentryHeads = malloc(DCACHE_BUCKETS * sizeof(int));
+  dentryReferenced = malloc(DCACHE_ENTRIES);
+  internArena = malloc(DCACHE_ARENA_BYTES);
+  internHeads = malloc(DCACHE_BUCKETS * sizeof(int));
+  if (dentries == NULL || dentryHeads == NULL || dentryReferenced == NULL ||
+      internArena == NULL || internHeads == NULL)
+  {
+    perror("Failed to allocate the dentry cache");
+    freeDentryCache();
+    return -1;
+  }
+
+  dcacheReset();
+
+  return 0;
+}
+
+void freeDentryCache()
+{
+  free(dentries);
+  dentries = NULL;
+  free(dentryHeads);
+  dentryHeads = NULL;
+  free(dentryReferenced);
+  dentryReferenced = NULL;
+  free(internArena);
+  internArena = NULL;
+  free(internHeads);
+  internHeads = NULL;
+}
+
+// find a dentry by key, -1 if it is not cached. name must be interned
+static int dentryFind(uint64_t parent, const char *name, unsigned int hash)
+{
+  int i = dentryHeads[hash & (DCACHE_BUCKETS - 1)];
+
+  while (i != -1)
+  {
+    if (dentries[i].name == name && dentries[i].parent == parent)
+    {
+      return i;
+    }
+    i = dentries[i].next;
+  }
+  return -1;
+}
+
+// find the dentry for a name that may not be interned, -1 if it is not cached
+static int dentryFindName(uint64_t parent, const char *name)
+{
+  unsigned int hash = nameHash(name);
+  const char *interned = internFind(name, hash);
+
+  if (interned == NULL)
+  {
+    return -1;
+  }
+  return dentryFind(parent, interned, dentryHash(parent, hash));
+}
+
+// take a dentry out of its hash chain and put it on the free list
+static void dentryRelease(int index)
+{
+  int *link = &dentryHeads[dentries[index].hash & (DCACHE_BUCKETS - 1)];
+
+  while (*link != index)
+  {
+    link = &dentries[*link].next;
+  }
+  *link = dentries[index].next;
+
+  dentries[index].name = NULL;
+  dentries[index].next = dentryFree;
+  dentryFree = index;
+}
+
+const Dentry *dcacheLookup(uint64_t parent, const char *name)
+{
+  if (dentries == NULL)
+  {
+    return NULL;
+  }
+
+  int i = dentryFindName(parent, name);
+  if (i == -1)
+  {
+    STAT_INC(dcache_misses);
+    return NULL;
+  }
+
+  STAT_INC(dcache_hits);
+  if (dentries[i].index == DENTRY_NEGATIVE)
+  {
+    STAT_INC(dcache_negatives);
+  }
+  dentryReferenced[i] = 1;
+  return &dentries[i];
+}
+
+// find or claim the dentry for a name, -1 if the name cannot be cached
+static int dentryClaim(uint64_t parent, const char *name)
+{
+  if (dentries == NULL || strlen(name) > PATH_MAX_NAME)
+  {
+    return -1;
+  }
+
+  // interning first, it may empty the cache to make room
+  unsigned int hash = nameHash(name);
+  name = intern(name, hash);
+  hash = dentryHash(parent, hash);
+  int i = dentryFind(parent, name, hash);
+
+  if (i == -1)
+  {
+    // pool is full, reuse the first dentry that was not used recently
+    if (dentryFree == -1)
+    {
+      while (dentryReferenced[dentryClock])
+      {
+        dentryReferenced[dentryClock] = 0;
+        dentryClock = (dentryClock + 1) % DCACHE_ENTRIES;
+      }
+      dentryRelease(dentryClock);
+      dentryClock = (dentryClock + 1) % DCACHE_ENTRIES;
+    }
+
+    i = dentryFree;
+    dentryFree = dentries[i].next;
+
+    int bucket = hash & (DCACHE_BUCKETS - 1);
+    dentries[i].next = dentryHeads[bucket];
+    dentryHeads[bucket] = i;
+    dentries[i].hash = hash;
+    dentries[i].parent = parent;
+    dentries[i].name = name;
+  }
+
+  dentryReferenced[i] = 1;
+  return i;
+}
+
+const Dentry *dcacheInsert(uint64_t parent, const char *name, int index,
+                           const DirectoryEntry *entry)
+{
+  int i = dentryClaim(parent, name);
+  if (i == -1)
+  {
+    return NULL;
+  }
+
+  dentries[i].index = index;
+  dentries[i].location = entry->location;
+  dentries[i].attributes = entry->attributes;
+  return &dentries[i];
+}
+
+void dcacheInsertNegative(uint64_t parent, const char *name)
+{
+  int i = dentryClaim(parent, name);
+  if (i == -1)
+  {
+    return;
+  }
+
+  dentries[i].index = DENTRY_NEGATIVE;
+  dentries[i].location = 0;
+  dentries[i].attributes = 0;
+}
+
+void dcacheRemove(uint64_t parent, const char *name)
+{
+  if (dentries == NULL)
+  {
+    return;
+  }
+
+  int i = dentryFindName(parent, name);
+  if (i != -1)
+  {
+    dentryRelease(i);
+  }
+}
+
+void dcachePurgeDir(uint64_t parent)
+{
+  if (dentries == NULL)
+  {
+    return;
+  }
+
+  for (int i = 0; i < DCACHE_ENTRIES; i++)
+  {
+    if (dentries[i].name != NULL && dentries[i].parent == parent)
+    {
+      dentryRelease(i);
+    }
+  }
+}
@@ -0,0 +1,58 @@
+/**************************************************************
+ * Class::  CSC-415-02 Spring 2024
+ * Name:: Thiha Aung, Min Ye Thway Khaing, Dylan Nguyen
+ * GitHub-Name:: thihaaung32
+ * Group-Name:: Bee
+ * Project:: Basic File System
+ *
+ * File:: dentryCache.h
+ *
+ * Description:: Interface of the dentry cache. It remembers what a
+ *            name resolved to inside a directory so path walks do
+ *            not have to load every directory along the way.
+ *
+ **************************************************************/
+
+#ifndef _DENTRY_CACHE_H
+#define _DENTRY_CACHE_H
+
+#include "structure.h"
+
+#define DCACHE_ENTRIES 4096          // number of names the cache remembers
+#define DCACHE_ARENA_BYTES (64 * 1024) // room for interned names, the cache starts over when full
+#define DENTRY_NEGATIVE -1           // index of a dentry for a name that does not exist
+
+// One cached name, keyed by (parent, name)
+typedef struct
+{
+  uint64_t parent;          // location of the directory holding the name
+  uint64_t location;        // block location of the entry itself
+  int index;                // slot of the entry in the parent directory, or DENTRY_NEGATIVE
+  unsigned char attributes; // attributes of the entry, 0 for a negative dentry
+  unsigned int hash;        // hash of (parent, name)
+  int next;                 // next dentry in the same hash chain
+  const char *name;         // interned, so equal names share one pointer. NULL when free
+} Dentry;
+
+int initDentryCache();
+void freeDentryCache();
+
+// Returns the cached dentry for name in parent, NULL if not cached
+const Dentry *dcacheLookup(uint64_t parent, const char *name);
+
+// Remembers that name in parent is the entry at slot index. Returns the
+// new dentry, NULL if the name cannot be cached
+const Dentry *dcacheInsert(uint64_t parent, const char *name, int index,
+                           const DirectoryEntry *entry);
+
+// Remembers that name is not in parent. Creating the name replaces it
+// through dcacheInsert
+void dcacheInsertNegative(uint64_t parent, const char *name);
+
+// Forgets name in parent, call when the entry is removed or renamed
+void dcacheRemove(uint64_t parent, const char *name);
+
+// Forgets every name inside a directory, call when it is removed
+void dcachePurgeDir(uint64_t parent);
+
+#endif
@@ -0,0 +1,264 @@
+/**************************************************************
+ * Class::  CSC-415-02 Spring 2024
+ * Name:: Thiha Aung, Min Ye Thway Khaing, Dylan Nguyen
+ * GitHub-Name:: thihaaung32
+ * Group-Name:: Bee
+ * Project:: Basic File System
+ *
+ * File:: dirBloom.c
+ *
+ * Description:: Directory Bloom filters. The filters live in memory
+ *            only. A filter is built by reading its directory once
+ *            and then follows inserts and removes, its counters let
+ *            a removed name be taken out again.
+ *
+ **************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "dirBloom.h"
+#include "directory.h"
+#include "fsStats.h"
+
+typedef struct
+{
+  uint64_t dir;            // directory location, 0 if the filter is unused
+  unsigned char *counts;   // one saturating counter per position
+  unsigned int mask;       // number of counters - 1
+  unsigned int names;      // names added since the filter was built
+  int referenced;          // second chance bit for the clock
+} DirBloom;
+
+DirBloom *blooms = NULL;
+int bloomClock = 0;
+
+int initDirBloom()
+{
+  blooms = calloc(BLOOM_FILTERS, sizeof(DirBloom));
+  if (blooms == NULL)
+  {
+    perror("Failed to allocate the directory filters");
+    return -1;
+  }
+  bloomClock = 0;
+  return 0;
+}
+
+static void bloomRelease(DirBloom *bloom)
+{
+  free(bloom->counts);
+  bloom->counts = NULL;
+  bloom->dir = 0;
+}
+
+void freeDirBloom()
+{
+  if (blooms == NULL)
+  {
+    return;
+  }
+
+  for (int i = 0; i < BLOOM_FILTERS; i++)
+  {
+    bloomRelease(&blooms[i]);
+  }
+  free(blooms);
+  blooms = NULL;
+}
+
+static DirBloom *bloomFind(uint64_t dir)
+{
+  for (int i = 0; i < BLOOM_FILTERS; i++)
+  {
+    if (blooms[i].dir == dir)
+    {
+      return &blooms[i];
+    }
+  }
+  return NULL;
+}
+
+// Counter positions of a name by double hashing, the second hash is
+// derived from the first so each name is hashed once
+static void bloomPositions(const DirBloom *bloom, const char *name, unsigned int *pos)
+{
+  unsigned int h1 = dirHash(name);
+  unsigned int h2 = ((h1 >> 16) | (h1 << 16)) * 0x9E3779B1u | 1;
+
+  for (int i = 0; i < BLOOM_HASHES; i++)
+  {
+    pos[i] = (h1 + i * h2) & bloom->mask;
+  }
+}
+
+static void bloomSet(DirBloom *bloom, const char *name)
+{
+  unsigned int pos[BLOOM_HASHES];
+  bloomPositions(bloom, name, pos);
+
+  for (int i = 0; i < BLOOM_HASHES; i++)
+  {
+    if (bloom->counts[pos[i]] < 255)
+    {
+      bloom->counts[pos[i]]++;
+    }
+  }
+  bloom->names++;
+}
+
+// Build the filter of a directory from its entries, reusing the least
+// recently used filter
+static DirBloom *bloomBuild(uint64_t dir)
+{
+  DirCursor *cursor = malloc(sizeof(DirCursor));
+  if (cursor == NULL || open_dir_cursor(dir, cursor) != 0)
+  {
+    free(cursor);
+    return NULL;
+  }
+
+  // size the filter for twice the names the directory has, so it can
+  // grow before it has to be rebuilt
+  unsigned int counters = BLOOM_MIN_COUNTERS;
+  while ((uint64_t)counters < (uint64_t)cursor->header.count * 2 * BLOOM_COUNTERS_PER_NAME &&
+         counters < (1u << 30))
+  {
+    counters <<= 1;
+  }
+
+  while (blooms[bloomClock].referenced)
+  {
+    blooms[bloomClock].referenced = 0;
+    bloomClock = (bloomClock + 1) % BLOOM_FILTERS;
+  }
+  DirBloom *bloom = &blooms[bloomClock];
+  bloomClock = (bloomClock + 1) % BLOOM_FILTERS;
+  bloomRelease(bloom);
+
+  bloom->counts = calloc(counters, 1);
+  if (bloom->counts == NULL)
+  {
+    free(cursor);
+    return NULL;
+  }
+  bloom->dir = dir;
+  bloom->mask = counters - 1;
+  bloom->names = 0;
+  bloom->referenced = 1;
+
+  DirectoryEntry entry;
+  while (cursor_next(cursor, &entry) == 0)
+  {
+    // "." and ".." are answered without the filter
+    if (cursor->index > DE_FIRST_SLOT)
+    {
+      bloomSet(bloom, entry.name);
+    }
+  }
+
+  free(cursor);
+  STAT_INC(bloom_builds);
+  return bloom;
+}
+
+int bloomMayContain(uint64_t dir, const char *name)
+{
+  if (blooms == NULL)
+  {
+    return 1;
+  }
+
+  DirBloom *bloom = bloomFind(dir);
+  if (bloom == NULL)
+  {
+    bloom = bloomBuild(dir);
+    if (bloom == NULL)
+    {
+      return 1;
+    }
+  }
+  bloom->referenced = 1;
+
+  unsigned int pos[BLOOM_HASHES];
+  bloomPositions(bloom, name, pos);
+
+  for (int i = 0; i < BLOOM_HASHES; i++)
+  {
+    if (bloom->counts[pos[i]] == 0)
+    {
+      STAT_INC(bloom_rejects);
+      return 0;
+    }
+  }
+  return 1;
+}
+
+void bloomAdd(uint64_t dir, const char *name)
+{
+  if (blooms == NULL)
+  {
+    return;
+  }
+
+  DirBloom *bloom = bloomFind(dir);
+  if (bloom == NULL)
+  {
+    return;
+  }
+
+  // a filter that has filled up answers "maybe" too often, build a
+  // bigger one the next time it is needed
+  if ((uint64_t)(bloom->names + 1) * BLOOM_COUNTERS_PER_NAME > (uint64_t)bloom->mask + 1 &&
+      bloom->mask + 1 < (1u << 30))
+  {
+    bloomRelease(bloom);
+    return;
+  }
+
+  bloomSet(bloom, name);
+}
+
+void bloomRemove(uint64_t dir, const char *name)
+{
+  if (blooms == NULL)
+  {
+    return;
+  }
+
+  DirBloom *bloom = bloomFind(dir);
+  if (bloom == NULL)
+  {
+    return;
+  }
+
+  unsigned int pos[BLOOM_HASHES];
+  bloomPositions(bloom, name, pos);
+
+  // a saturated counter no longer knows its true count, so it stays
+  for (int i = 0; i < BLOOM_HASHES; i++)
+  {
+    if (bloom->counts[pos[i]] > 0 && bloom->counts[pos[i]] < 255)
+    {
+      bloom->counts[pos[i]]--;
+    }
+  }
+  if (bloom->names > 0)
+  {
+    bloom->names--;
+  }
+}
+
+void bloomDrop(uint64_t dir)
+{
+  if (blooms == NULL)
+  {
+    return;
+  }
+
+  DirBloom *bloom = bloomFind(dir);
+  if (bloom != NULL)
+  {
+    bloomRelease(bloom);
+  }
+}
@@ -0,0 +1,41 @@
+/**************************************************************
+ * Class::  CSC-415-02 Spring 2024
+ * Name:: Thiha Aung, Min Ye Thway Khaing, Dylan Nguyen
+ * GitHub-Name:: thihaaung32
+ * Group-Name:: Bee
+ * Project:: Basic File System
+ *
+ * File:: dirBloom.h
+ *
+ * Description:: Interface of the directory Bloom filters. Each
+ *            recently used directory gets a counting Bloom filter of
+ *            its names, so a name that is not there is turned away
+ *            without probing the directory.
+ *
+ **************************************************************/
+
+#ifndef _DIR_BLOOM_H
+#define _DIR_BLOOM_H
+
+#include "structure.h"
+
+#define BLOOM_FILTERS 64          // directories with a filter at a time
+#define BLOOM_MIN_COUNTERS 1024   // smallest filter, a power of two
+#define BLOOM_COUNTERS_PER_NAME 8 // fewest counters per name before a rebuild
+#define BLOOM_HASHES 4            // counters set per name
+
+int initDirBloom();
+void freeDirBloom();
+
+// 0 if name is definitely not in dir, 1 if it may be. The filter is
+// built from the directory the first time it is asked about
+int bloomMayContain(uint64_t dir, const char *name);
+
+// Keep a directory's filter in step with its entries
+void bloomAdd(uint64_t dir, const char *name);
+void bloomRemove(uint64_t dir, const char *name);
+
+// Forget the filter of a directory, call when it is removed
+void bloomDrop(uint64_t dir);
+
+#endif
@@ -0,0 +1,258 @@
+/**************************************************************
+ * Class::  CSC-415-02 Spring 2024
+ * Name:: Thiha Aung, Min Ye Thway Khaing, Dylan Nguyen
+ * GitHub-Name:: thihaaung32
+ * Group-Name:: Bee
+ * Project:: Basic File System
+ *
+ * File:: dirIndex.c
+ *
+ * Description:: Directory name indexes. The indexes live in memory
+ *            only, like the directory filters. An index is built by
+ *            reading its directory once and sorting the names, then
+ *            follows inserts and removes by binary search.
+ *
+ **************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "dirIndex.h"
+#include "directory.h"
+#include "fsStats.h"
+
+DirIndex *indexes = NULL;
+int indexClock = 0;
+
+int initDirIndex()
+{
+  indexes = calloc(DIR_INDEXES, sizeof(DirIndex));
+  if (indexes == NULL)
+  {
+    perror("Failed to allocate the directory indexes");
+    return -1;
+  }
+  indexClock = 0;
+  return 0;
+}
+
+static void indexRelease(DirIndex *index)
+{
+  for (int i = 0; i < index->count; i++)
+  {
+    free(index->names[i]);
+  }
+  free(index->names);
+  index->names = NULL;
+  index->count = 0;
+  index->capacity = 0;
+  index->dir = 0;
+}
+
+void freeDirIndex()
+{
+  if (indexes == NULL)
+  {
+    return;
+  }
+
+  for (int i = 0; i < DIR_INDEXES; i++)
+  {
+    indexRelease(&indexes[i]);
+  }
+  free(indexes);
+  indexes = NULL;
+}
+
+static DirIndex *indexFind(uint64_t dir)
+{
+  for (int i = 0; i < DIR_INDEXES; i++)
+  {
+    if (indexes[i].dir == dir)
+    {
+      return &indexes[i];
+    }
+  }
+  return NULL;
+}
+
+static int compareNames(const void *a, const void *b)
+{
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Make room for one more name, 0 on success
+static int indexReserve(DirIndex *index)
+{
+  if (index->count < index->capacity)
+  {
+    return 0;
+  }
+
+  int capacity = index->capacity > 0 ? index->capacity * 2 : DIR_INDEX_MIN_NAMES;
+  char **names = realloc(index->names, capacity * sizeof(char *));
+  if (names == NULL)
+  {
+    return -1;
+  }
+  index->names = names;
+  index->capacity = capacity;
+  return 0;
+}
+
+// Build the index of a directory from its entries, reusing the least
+// recently used index
+static DirIndex *indexBuild(uint64_t dir)
+{
+  DirCursor *cursor = malloc(sizeof(DirCursor));
+  if (cursor == NULL || open_dir_cursor(dir, cursor) != 0)
+  {
+    free(cursor);
+    return NULL;
+  }
+
+  while (indexes[indexClock].referenced)
+  {
+    indexes[indexClock].referenced = 0;
+    indexClock = (indexClock + 1) % DIR_INDEXES;
+  }
+  DirIndex *index = &indexes[indexClock];
+  indexClock = (indexClock + 1) % DIR_INDEXES;
+  indexRelease(index);
+
+  DirectoryEntry entry;
+  while (cursor_next(cursor, &entry) == 0)
+  {
+    // "." and ".." are listed ahead of the index
+    if (cursor->index <= DE_FIRST_SLOT)
+    {
+      continue;
+    }
+
+    char *name = strdup(entry.name);
+    if (name == NULL || indexReserve(index) != 0)
+    {
+      free(name);
+      indexRelease(index);
+      free(cursor);
+      return NULL;
+    }
+    index->names[index->count++] = name;
+  }
+  free(cursor);
+
+  qsort(index->names, index->count, sizeof(char *), compareNames);
+  index->dir = dir;
+  index->referenced = 1;
+  STAT_INC(index_builds);
+  return index;
+}
+
+const DirIndex *dirIndexGet(uint64_t dir)
+{
+  if (indexes == NULL)
+  {
+    return NULL;
+  }
+
+  DirIndex *index = indexFind(dir);
+  if (index == NULL)
+  {
+    index = indexBuild(dir);
+    if (index == NULL)
+    {
+      return NULL;
+    }
+  }
+  index->referenced = 1;
+  return index;
+}
+
+int dirIndexSeek(const DirIndex *index, const char *key, int after)
+{
+  int low = 0;
+  int high = index->count;
+
+  while (low < high)
+  {
+    int middle = low + (high - low) / 2;
+    int cmp = strcmp(index->names[middle], key);
+    if (cmp < 0 || (after && cmp == 0))
+    {
+      low = middle + 1;
+    }
+    else
+    {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+void dirIndexAdd(uint64_t dir, const char *name)
+{
+  if (indexes == NULL)
+  {
+    return;
+  }
+
+  DirIndex *index = indexFind(dir);
+  if (index == NULL)
+  {
+    return;
+  }
+
+  // an index that cannot take the name is dropped and built again later
+  char *copy = strdup(name);
+  if (copy == NULL || indexReserve(index) != 0)
+  {
+    free(copy);
+    indexRelease(index);
+    return;
+  }
+
+  int pos = dirIndexSeek(index, name, 0);
+  memmove(&index->names[pos + 1], &index->names[pos],
+          (index->count - pos) * sizeof(char *));
+  index->names[pos] = copy;
+  index->count++;
+}
+
+void dirIndexRemove(uint64_t dir, const char *name)
+{
+  if (indexes == NULL)
+  {
+    return;
+  }
+
+  DirIndex *index = indexFind(dir);
+  if (index == NULL)
+  {
+    return;
+  }
+
+  int pos = dirIndexSeek(index, name, 0);
+  if (pos == index->count || strcmp(index->names[pos], name) != 0)
+  {
+    return;
+  }
+
+  free(index->names[pos]);
+  memmove(&index->names[pos], &index->names[pos + 1],
+          (index->count - pos - 1) * sizeof(char *));
+  index->count--;
+}
+
+void dirIndexDrop(uint64_t dir)
+{
+  if (indexes == NULL)
+  {
+    return;
+  }
+
+  DirIndex *index = indexFind(dir);
+  if (index != NULL)
+  {
+    indexRelease(index);
+  }
+}
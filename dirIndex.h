@@ -0,0 +1,53 @@
+/**************************************************************
+ * Class::  CSC-415-02 Spring 2024
+ * Name:: Thiha Aung, Min Ye Thway Khaing, Dylan Nguyen
+ * GitHub-Name:: thihaaung32
+ * Group-Name:: Bee
+ * Project:: Basic File System
+ *
+ * File:: dirIndex.h
+ *
+ * Description:: Interface of the directory name indexes. An index
+ *            keeps the names of one directory in order, so sorted
+ *            listings and prefix scans read the names they return
+ *            instead of sorting the whole directory each time.
+ *
+ **************************************************************/
+
+#ifndef _DIR_INDEX_H
+#define _DIR_INDEX_H
+
+#include "structure.h"
+
+#define DIR_INDEXES 16         // directories with an index at a time
+#define DIR_INDEX_MIN_NAMES 64 // smallest name array of an index
+
+// The names of one directory in strcmp order, without "." and ".."
+typedef struct
+{
+  uint64_t dir;   // directory location, 0 if the index is unused
+  char **names;   // each name allocated on its own
+  int count;      // names in use
+  int capacity;   // size of names
+  int referenced; // second chance bit for the clock
+} DirIndex;
+
+int initDirIndex();
+void freeDirIndex();
+
+// The index of a directory, built from the directory the first time it
+// is asked for. It stays valid until the directory changes or another
+// index is built. NULL if it could not be built.
+const DirIndex *dirIndexGet(uint64_t dir);
+
+// Position of the first name not below key, or above key if after is set
+int dirIndexSeek(const DirIndex *index, const char *key, int after);
+
+// Keep a directory's index in step with its entries
+void dirIndexAdd(uint64_t dir, const char *name);
+void dirIndexRemove(uint64_t dir, const char *name);
+
+// Forget the index of a directory, call when it is removed
+void dirIndexDrop(uint64_t dir);
+
+#endif
@@ -0,0 +1,918 @@
+/**************************************************************
+ * Class::  CSC-415-02 Spring 2024
+ * Name:: Thiha Aung, Min Ye Thway Khaing, Dylan Nguyen
+ * GitHub-Name:: thihaaung32
+ * Group-Name:: Bee
+ * Project:: Basic File System
+ *
+ * File:: directory.c
+ *
+ * Description:: Directory Operations. Every access goes through the
+ *            buffer cache and only touches the header and the slots
+ *            it needs.
+ *
+ **************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <time.h>
+#include "fsLow.h"
+#include "directory.h"
+#include "freeSpaceManagement.h"
+#include "memo.h"
+#include "fsStats.h"
+#include "inode.h"
+#include "dirBloom.h"
+#include "dirIndex.h"
+#include "journal.h"
+
+int dirBlocks;
+int dirBytes;
+int dirEntries;
+
+// the header is read and written as a single block
+typedef char dir_header_fits_block[sizeof(DirHeader) <= MINBLOCKSIZE ? 1 : -1];
+// the record layout is part of the on-disk format
+typedef char dir_record_is_64_bytes[sizeof(DirRecord) == 64 ? 1 : -1];
+
+// size directories for the volume's block size
+void initDirGeometry()
+{
+  int slot_blocks = get_num_blocks(sizeof(DirRecord) * DE_COUNT, myVCB->block_size);
+
+  dirBlocks = slot_blocks + 1;
+  dirBytes = dirBlocks * myVCB->block_size;
+  dirEntries = (slot_blocks * myVCB->block_size) / sizeof(DirRecord);
+}
+
+// FNV-1a, it is part of the on-disk format so it must never change
+unsigned int dirHash(const char *name)
+{
+  unsigned int hash = 2166136261u;
+
+  while (*name != '\0')
+  {
+    hash = (hash ^ (unsigned char)*name++) * 16777619u;
+  }
+  return hash;
+}
+
+int load_dir_header(uint64_t location, DirHeader *header)
+{
+  if (cacheReadBytes(header, location, 0, sizeof(DirHeader)) != 0)
+  {
+    return -1;
+  }
+  STAT_INC(dir_reads);
+
+  if (header->magic != DIR_MAGIC || header->version != DIR_VERSION)
+  {
+    printf("Block %lu is not a directory\n", location);
+    return -1;
+  }
+  return 0;
+}
+
+int write_dir_header(const DirHeader *header)
+{
+  STAT_INC(dir_writes);
+  return cacheWriteBytes(header, header->location, 0, sizeof(DirHeader));
+}
+
+// read the record in one slot of a segment
+static int read_slot(const DirSegment *seg, unsigned int slot, DirRecord *rec)
+{
+  STAT_INC(dir_reads);
+  return cacheReadBytes(rec, seg->location, (uint64_t)slot * sizeof(DirRecord),
+                        sizeof(DirRecord));
+}
+
+// write the record in one slot of a segment
+static int write_slot(const DirSegment *seg, unsigned int slot, const DirRecord *rec)
+{
+  STAT_INC(dir_writes);
+  return cacheWriteBytes(rec, seg->location, (uint64_t)slot * sizeof(DirRecord),
+                         sizeof(DirRecord));
+}
+
+// offset of a long name in the name heap, kept in the record's name bytes
+static uint64_t heap_offset(const DirRecord *rec)
+{
+  uint64_t offset;
+  memcpy(&offset, rec->name, sizeof(offset));
+  return offset;
+}
+
+// read a long name from the name heap
+static int read_heap_name(const DirHeader *header, const DirRecord *rec, char *name)
+{
+  uint64_t offset = heap_offset(rec);
+  uint64_t block = get_block(header->heap_location, BLOCK_INDEX(offset));
+
+  STAT_INC(dir_reads);
+  return cacheReadBytes(name, block, BLOCK_OFFSET(offset), rec->name_len + 1);
+}
+
+// Add a long name to the name heap and return its offset, or -1. Names
+// never cross a block boundary, so a name that does not fit in the rest
+// of the last block starts a new one. The header is updated in memory only.
+static int64_t append_heap_name(DirHeader *header, const char *name)
+{
+  uint64_t length = strlen(name) + 1;
+
+  if (BLOCK_OFFSET(header->heap_used) + length > blockSize)
+  {
+    uint64_t next = BLOCKS_TO_BYTES(BLOCK_INDEX(header->heap_used) + 1);
+    header->heap_garbage += next - header->heap_used;
+    header->heap_used = next;
+  }
+
+  // link a new block onto the end of the heap
+  if (BLOCK_INDEX(header->heap_used) >= header->heap_blocks)
+  {
+    int64_t location = allocateBlock(1);
+    if (location == -1)
+    {
+      return -1;
+    }
+
+    if (header->heap_blocks == 0)
+    {
+      header->heap_location = location;
+    }
+    else
+    {
+      set_next_block(get_block(header->heap_location, header->heap_blocks - 1), location);
+    }
+    header->heap_blocks++;
+    header->num_blocks++;
+  }
+
+  uint64_t offset = header->heap_used;
+  uint64_t block = get_block(header->heap_location, BLOCK_INDEX(offset));
+
+  STAT_INC(dir_writes);
+  if (cacheWriteBytes(name, block, BLOCK_OFFSET(offset), length) != 0)
+  {
+    return -1;
+  }
+
+  header->heap_used += length;
+  return offset;
+}
+
+// the name of a record, copied into name which holds at least 256 bytes
+static int record_name(const DirHeader *header, const DirRecord *rec, char *name)
+{
+  if (rec->name_len > DIR_INLINE_NAME)
+  {
+    return read_heap_name(header, rec, name);
+  }
+
+  memcpy(name, rec->name, rec->name_len);
+  name[rec->name_len] = '\0';
+  return 0;
+}
+
+// true if a live record holds name, the hash and length settle most misses
+static int record_matches(const DirHeader *header, const DirRecord *rec,
+                          const char *name, unsigned int hash, size_t length)
+{
+  if (rec->hash != hash || rec->name_len != length)
+  {
+    return 0;
+  }
+
+  STAT_INC(de_compares);
+  if (length <= DIR_INLINE_NAME)
+  {
+    return memcmp(rec->name, name, length) == 0;
+  }
+
+  char long_name[256];
+  return read_heap_name(header, rec, long_name) == 0 && strcmp(long_name, name) == 0;
+}
+
+// expand a record into a directory entry, the metadata comes from its inode
+static int record_to_de(const DirHeader *header, const DirRecord *rec, DirectoryEntry *entry)
+{
+  memset(entry, 0, sizeof(DirectoryEntry));
+  if (read_inode(rec->inode, entry) != 0)
+  {
+    return -1;
+  }
+  entry->attributes = rec->attributes;
+  return record_name(header, rec, entry->name);
+}
+
+// Walks the probe chain of name in one segment. Returns the slot holding
+// name, or -1. *avail is set to the first slot on the chain a new record
+// could use.
+static int probe(const DirHeader *header, const DirSegment *seg, const char *name,
+                 unsigned int hash, DirRecord *rec, int *avail)
+{
+  size_t length = strlen(name);
+  unsigned int slot = hash % seg->capacity;
+  *avail = -1;
+
+  for (unsigned int n = 0; n < seg->capacity; n++)
+  {
+    read_slot(seg, slot, rec);
+
+    if (rec->attributes == DE_AVAILABLE)
+    {
+      if (*avail == -1)
+      {
+        *avail = slot;
+      }
+      return -1;
+    }
+
+    if (rec->attributes == DE_REMOVED)
+    {
+      if (*avail == -1)
+      {
+        *avail = slot;
+      }
+    }
+    else if (record_matches(header, rec, name, hash, length))
+    {
+      return slot;
+    }
+
+    slot = (slot + 1) % seg->capacity;
+  }
+  return -1;
+}
+
+// Finds name in any segment. Returns the entry index and sets the segment
+// and slot holding it, or returns -1.
+static int find_record(const DirHeader *header, const char *name, DirRecord *rec,
+                       int *seg_out, int *slot_out)
+{
+  unsigned int hash = dirHash(name);
+  int base = DE_FIRST_SLOT;
+
+  for (unsigned int i = 0; i < header->segments; i++)
+  {
+    int avail;
+    int slot = probe(header, &header->segment[i], name, hash, rec, &avail);
+    if (slot != -1)
+    {
+      *seg_out = i;
+      *slot_out = slot;
+      return base + slot;
+    }
+    base += header->segment[i].capacity;
+  }
+  return -1;
+}
+
+// Write an empty slot array: every slot's attributes are DE_AVAILABLE and
+// everything else is zero. Written a chunk of blocks at a time so large
+// segments do not need one buffer the size of the whole array.
+static int write_empty_slots(uint64_t location, unsigned int num_blocks)
+{
+  unsigned int chunk_blocks = num_blocks < 64 ? num_blocks : 64;
+  char *chunk = malloc(BLOCKS_TO_BYTES(chunk_blocks));
+  uint64_t attr = offsetof(DirRecord, attributes);
+
+  for (unsigned int done = 0; done < num_blocks; done += chunk_blocks)
+  {
+    unsigned int blocks = num_blocks - done < chunk_blocks ? num_blocks - done : chunk_blocks;
+    uint64_t start = BLOCKS_TO_BYTES(done);
+    uint64_t end = start + BLOCKS_TO_BYTES(blocks);
+
+    memset(chunk, 0, BLOCKS_TO_BYTES(blocks));
+
+    // attributes byte of the first slot starting in or before this chunk
+    uint64_t pos = (start / sizeof(DirRecord)) * sizeof(DirRecord) + attr;
+    if (pos < start)
+    {
+      pos += sizeof(DirRecord);
+    }
+    for (; pos < end; pos += sizeof(DirRecord))
+    {
+      chunk[pos - start] = DE_AVAILABLE;
+    }
+
+    if (cacheWrite(chunk, blocks, location + done) != blocks)
+    {
+      free(chunk);
+      return -1;
+    }
+  }
+
+  free(chunk);
+  return 0;
+}
+
+// Append a segment of num_blocks blocks to a directory, the header is
+// updated in memory only
+static int add_segment(DirHeader *header, unsigned int num_blocks)
+{
+  if (header->segments == DIR_MAX_SEGMENTS)
+  {
+    perror("No available space in directory\n");
+    return -1;
+  }
+
+  // the slots of a segment must be contiguous, allocateBlock hands out
+  // runs of consecutive blocks
+  int64_t location = allocateBlock(num_blocks);
+  if (location == -1)
+  {
+    return -1;
+  }
+
+  if (write_empty_slots(location, num_blocks) != 0)
+  {
+    perror("LBAwrite failed\n");
+    return -1;
+  }
+
+  DirSegment *seg = &header->segment[header->segments++];
+  seg->location = location;
+  seg->num_blocks = num_blocks;
+  seg->capacity = BLOCKS_TO_BYTES(num_blocks) / sizeof(DirRecord);
+  seg->count = 0;
+  seg->tombstones = 0;
+
+  header->num_blocks += num_blocks;
+
+  return 0;
+}
+// Initialize a directory with one empty segment, "." and ".." are
+// kept in the header
+int64_t initRootDirectory(uint64_t parent_location)
+{
+  // allocate free space for the header
+  int64_t dir_location = allocateBlock(1);
+  if (dir_location == -1)
+  {
+    return -1;
+  }
+
+  DirHeader header;
+  memset(&header, 0, sizeof(DirHeader));
+  header.magic = DIR_MAGIC;
+  header.version = DIR_VERSION;
+  header.location = dir_location;
+  header.num_blocks = 1;
+  time_t curr_time = time(NULL);
+  header.timeCreated = curr_time;
+  header.timeLastModified = curr_time;
+  header.timeLastViewed = curr_time;
+
+  // the root directory is its own parent
+  if (parent_location == 0)
+  {
+    // track number of blocks root directory has
+    myVCB->root_blocks = dirBlocks;
+    header.parent = dir_location;
+  }
+  else
+  {
+    header.parent = parent_location;
+  }
+
+  // write new directory to disk
+  if (add_segment(&header, dirBlocks - 1) != 0)
+  {
+    release_blocks(dir_location, 1);
+    return -1;
+  }
+  if (write_dir_header(&header) != 0)
+  {
+    perror("LBAwrite failed\n");
+    return -1;
+  }
+
+  return dir_location;
+}
+
+// fill in a "." or ".." entry from a directory header
+static void header_to_de(const DirHeader *header, const char *name, DirectoryEntry *entry)
+{
+  memset(entry, 0, sizeof(DirectoryEntry));
+  entry->location = header->location;
+  entry->num_blocks = header->num_blocks;
+  entry->size = BLOCKS_TO_BYTES(header->num_blocks);
+  entry->timeCreated = header->timeCreated;
+  entry->timeLastModified = header->timeLastModified;
+  entry->timeLastViewed = header->timeLastViewed;
+  entry->attributes = 'd';
+  strcpy(entry->name, name);
+}
+
+int read_de(uint64_t dir, int index, DirectoryEntry *entry)
+{
+  DirHeader header;
+  if (load_dir_header(dir, &header) != 0)
+  {
+    return -1;
+  }
+
+  if (index == DE_SELF)
+  {
+    header_to_de(&header, ".", entry);
+    return 0;
+  }
+
+  if (index == DE_PARENT)
+  {
+    DirHeader parent;
+    if (load_dir_header(header.parent, &parent) != 0)
+    {
+      return -1;
+    }
+    header_to_de(&parent, "..", entry);
+    return 0;
+  }
+
+  if (index < DE_FIRST_SLOT)
+  {
+    return -1;
+  }
+
+  // find the segment the index falls in
+  unsigned int slot = index - DE_FIRST_SLOT;
+  for (unsigned int i = 0; i < header.segments; i++)
+  {
+    if (slot < header.segment[i].capacity)
+    {
+      DirRecord rec;
+      if (read_slot(&header.segment[i], slot, &rec) != 0)
+      {
+        return -1;
+      }
+      return record_to_de(&header, &rec, entry);
+    }
+    slot -= header.segment[i].capacity;
+  }
+  return -1;
+}
+
+int get_de_index(uint64_t dir, const char *name, DirectoryEntry *entry)
+{
+  DirectoryEntry scratch;
+  if (entry == NULL)
+  {
+    entry = &scratch;
+  }
+
+  if (strcmp(name, ".") == 0)
+  {
+    return read_de(dir, DE_SELF, entry) == 0 ? DE_SELF : -1;
+  }
+  if (strcmp(name, "..") == 0)
+  {
+    return read_de(dir, DE_PARENT, entry) == 0 ? DE_PARENT : -1;
+  }
+
+  // names the directory's filter has never seen are not there
+  if (bloomMayContain(dir, name) == 0)
+  {
+    return -1;
+  }
+
+  DirHeader header;
+  if (load_dir_header(dir, &header) != 0)
+  {
+    return -1;
+  }
+
+  DirRecord rec;
+  int seg, slot;
+  int index = find_record(&header, name, &rec, &seg, &slot);
+  // a caller only asking whether the name is there needs no inode read
+  if (index != -1 && entry != &scratch && record_to_de(&header, &rec, entry) != 0)
+  {
+    return -1;
+  }
+  return index;
+}
+
+int next_de(uint64_t dir, int *index, DirectoryEntry *entry)
+{
+  if (*index < DE_FIRST_SLOT)
+  {
+    if (read_de(dir, *index, entry) != 0)
+    {
+      return -1;
+    }
+    (*index)++;
+    return 0;
+  }
+
+  DirHeader header;
+  if (load_dir_header(dir, &header) != 0)
+  {
+    return -1;
+  }
+
+  int base = DE_FIRST_SLOT;
+  for (unsigned int i = 0; i < header.segments; i++)
+  {
+    const DirSegment *seg = &header.segment[i];
+
+    // skip segments that are already behind the cursor, or empty
+    if (*index >= base + (int)seg->capacity || seg->count == 0)
+    {
+      base += seg->capacity;
+      continue;
+    }
+
+    unsigned int slot = *index > base ? *index - base : 0;
+    for (; slot < seg->capacity; slot++)
+    {
+      DirRecord rec;
+      read_slot(seg, slot, &rec);
+
+      if (rec.attributes != DE_AVAILABLE && rec.attributes != DE_REMOVED)
+      {
+        *index = base + slot + 1;
+        return record_to_de(&header, &rec, entry);
+      }
+    }
+    base += seg->capacity;
+  }
+
+  *index = base;
+  return -1;
+}
+
+// true if a segment can take another entry in an unused slot
+static int segment_has_room(const DirSegment *seg)
+{
+  return (uint64_t)(seg->count + seg->tombstones + 1) * 100 <=
+         (uint64_t)seg->capacity * DIR_MAX_LOAD;
+}
+
+// adds entry to the directory whose header is loaded, the caller writes
+// the header back. Returns the entry's index or -1
+static int insert_record(DirHeader *header, const DirectoryEntry *entry)
+{
+  if (entry->inode == INODE_NONE)
+  {
+    printf("%s has no inode\n", entry->name);
+    return -1;
+  }
+
+  // the name must not exist in any segment, the first segment with room
+  // on the name's probe chain takes the entry
+  unsigned int hash = dirHash(entry->name);
+  DirRecord rec;
+  int target = -1;
+  int target_slot = -1;
+  int target_base = 0;
+  int base = DE_FIRST_SLOT;
+
+  for (unsigned int i = 0; i < header->segments; i++)
+  {
+    int avail;
+    if (probe(header, &header->segment[i], entry->name, hash, &rec, &avail) != -1)
+    {
+      printf("file or directory already exists\n");
+      return -1;
+    }
+
+    if (target == -1 && avail != -1)
+    {
+      // a removed slot is always reused, an unused one only below the load limit
+      read_slot(&header->segment[i], avail, &rec);
+      if (rec.attributes == DE_REMOVED || segment_has_room(&header->segment[i]))
+      {
+        target = i;
+        target_slot = avail;
+        target_base = base;
+      }
+    }
+    base += header->segment[i].capacity;
+  }
+
+  // every segment is full, grow the directory by twice its last segment
+  if (target == -1)
+  {
+    DirSegment *last = &header->segment[header->segments - 1];
+    if (add_segment(header, last->num_blocks * 2) != 0)
+    {
+      return -1;
+    }
+
+    target = header->segments - 1;
+    target_slot = hash % header->segment[target].capacity;
+    target_base = base;
+  }
+
+  DirSegment *seg = &header->segment[target];
+
+  // a removed slot on the chain is reused before an unused one
+  read_slot(seg, target_slot, &rec);
+  if (rec.attributes == DE_REMOVED)
+  {
+    seg->tombstones--;
+  }
+
+  // build the record, long names go to the name heap
+  memset(&rec, 0, sizeof(DirRecord));
+  rec.inode = entry->inode;
+  rec.attributes = entry->attributes;
+  rec.hash = hash;
+  rec.name_len = strlen(entry->name);
+  if (rec.name_len > DIR_INLINE_NAME)
+  {
+    int64_t offset = append_heap_name(header, entry->name);
+    if (offset == -1)
+    {
+      return -1;
+    }
+    uint64_t heap_offset = offset;
+    memcpy(rec.name, &heap_offset, sizeof(heap_offset));
+  }
+  else
+  {
+    memcpy(rec.name, entry->name, rec.name_len);
+  }
+
+  write_slot(seg, target_slot, &rec);
+
+  seg->count++;
+  header->count++;
+  header->timeLastModified = time(NULL);
+  bloomAdd(header->location, entry->name);
+  dirIndexAdd(header->location, entry->name);
+
+  return target_base + target_slot;
+}
+
+int insert_de(uint64_t dir, const DirectoryEntry *entry)
+{
+  DirHeader header;
+  if (load_dir_header(dir, &header) != 0)
+  {
+    return -1;
+  }
+
+  int index = insert_record(&header, entry);
+  if (index != -1)
+  {
+    write_dir_header(&header);
+  }
+  return index;
+}
+
+int insert_de_batch(uint64_t dir, const DirectoryEntry *entries, int count)
+{
+  DirHeader header;
+  if (load_dir_header(dir, &header) != 0)
+  {
+    return -1;
+  }
+
+  // the header is written once, after the last entry
+  int inserted = 0;
+  while (inserted < count && insert_record(&header, &entries[inserted]) != -1)
+  {
+    inserted++;
+  }
+
+  if (inserted > 0)
+  {
+    write_dir_header(&header);
+  }
+  return inserted;
+}
+
+int remove_de(uint64_t dir, const char *name)
+{
+  DirHeader header;
+  if (load_dir_header(dir, &header) != 0)
+  {
+    return -1;
+  }
+
+  DirRecord rec;
+  int seg_index, slot;
+  if (find_record(&header, name, &rec, &seg_index, &slot) == -1)
+  {
+    return -1;
+  }
+  DirSegment *seg = &header.segment[seg_index];
+
+  // heap space of a long name is not reused
+  if (rec.name_len > DIR_INLINE_NAME)
+  {
+    header.heap_garbage += rec.name_len + 1;
+  }
+
+  // a slot followed by an unused one ends no other chain, so it can go
+  // back to unused instead of becoming a tombstone
+  DirRecord next;
+  read_slot(seg, (slot + 1) % seg->capacity, &next);
+
+  memset(&rec, 0, sizeof(DirRecord));
+  if (next.attributes == DE_AVAILABLE)
+  {
+    rec.attributes = DE_AVAILABLE;
+  }
+  else
+  {
+    rec.attributes = DE_REMOVED;
+    seg->tombstones++;
+  }
+  write_slot(seg, slot, &rec);
+
+  seg->count--;
+  header.count--;
+  header.timeLastModified = time(NULL);
+  write_dir_header(&header);
+  bloomRemove(dir, name);
+  dirIndexRemove(dir, name);
+
+  return 0;
+}
+
+int open_dir_cursor(uint64_t dir, DirCursor *cursor)
+{
+  if (load_dir_header(dir, &cursor->header) != 0 ||
+      load_dir_header(cursor->header.parent, &cursor->parentHeader) != 0)
+  {
+    return -1;
+  }
+
+  cursor->index = DE_SELF;
+  cursor->batchStart = DE_FIRST_SLOT;
+  cursor->batchCount = 0;
+  cursor->segmentEnd = DE_FIRST_SLOT;
+  cursor->segmentLeft = 0;
+  cursor->left = cursor->header.count;
+  return 0;
+}
+
+// Read the batch holding cursor->index. A batch never crosses a segment,
+// so it is one contiguous cache read. Returns -1 past the last segment.
+static int fill_batch(DirCursor *cursor)
+{
+  int base = DE_FIRST_SLOT;
+
+  for (unsigned int i = 0; i < cursor->header.segments; i++)
+  {
+    const DirSegment *seg = &cursor->header.segment[i];
+
+    if (cursor->index >= base + (int)seg->capacity)
+    {
+      base += seg->capacity;
+      continue;
+    }
+
+    // empty segments are skipped without reading them
+    if (seg->count == 0)
+    {
+      cursor->index = base + seg->capacity;
+      base += seg->capacity;
+      continue;
+    }
+
+    // entering a segment, its live count says when to leave it
+    if (cursor->segmentEnd != base + (int)seg->capacity)
+    {
+      cursor->segmentEnd = base + seg->capacity;
+      cursor->segmentLeft = seg->count;
+    }
+
+    unsigned int slot = cursor->index - base;
+    unsigned int count = seg->capacity - slot;
+    if (count > DIR_CURSOR_BATCH)
+    {
+      count = DIR_CURSOR_BATCH;
+    }
+
+    STAT_INC(dir_reads);
+    if (cacheReadBytes(cursor->batch, seg->location, (uint64_t)slot * sizeof(DirRecord),
+                       count * sizeof(DirRecord)) != 0)
+    {
+      return -1;
+    }
+
+    cursor->batchStart = cursor->index;
+    cursor->batchCount = count;
+    return 0;
+  }
+  return -1;
+}
+
+int cursor_next(DirCursor *cursor, DirectoryEntry *entry)
+{
+  if (cursor->index == DE_SELF)
+  {
+    header_to_de(&cursor->header, ".", entry);
+    cursor->index++;
+    return 0;
+  }
+
+  if (cursor->index == DE_PARENT)
+  {
+    header_to_de(&cursor->parentHeader, "..", entry);
+    cursor->index++;
+    return 0;
+  }
+
+  // nothing live is left past the last live record
+  while (cursor->left > 0)
+  {
+    // refill once the batch is used up
+    if (cursor->index >= cursor->batchStart + cursor->batchCount)
+    {
+      if (fill_batch(cursor) != 0)
+      {
+        return -1;
+      }
+    }
+
+    const DirRecord *rec = &cursor->batch[cursor->index - cursor->batchStart];
+    cursor->index++;
+
+    if (rec->attributes != DE_AVAILABLE && rec->attributes != DE_REMOVED)
+    {
+      if (record_to_de(&cursor->header, rec, entry) != 0)
+      {
+        return -1;
+      }
+      cursor->left--;
+
+      // the rest of the segment is empty, skip to the next one
+      if (--cursor->segmentLeft == 0)
+      {
+        cursor->index = cursor->segmentEnd;
+      }
+      return 0;
+    }
+  }
+  return -1;
+}
+
+int set_de_parent(uint64_t dir, uint64_t parent)
+{
+  DirHeader header;
+  if (load_dir_header(dir, &header) != 0)
+  {
+    return -1;
+  }
+
+  header.parent = parent;
+  return write_dir_header(&header);
+}
+
+int release_dirs(const uint64_t *locations, int count)
+{
+  // a directory's blocks went through the journal, a replay after they
+  // have a new owner must not write the old records over it
+  if (count > 0 && journalCheckpoint() != 0)
+  {
+    return -1;
+  }
+
+  for (int i = 0; i < count; i++)
+  {
+    DirHeader header;
+    if (load_dir_header(locations[i], &header) != 0)
+    {
+      return -1;
+    }
+
+    for (unsigned int j = 0; j < header.segments; j++)
+    {
+      if (release_blocks(header.segment[j].location, header.segment[j].num_blocks) != 0)
+      {
+        return -1;
+      }
+    }
+
+    // the heap is a chain of single blocks, freed a consecutive run at a
+    // time. Each link is read before its run is freed
+    int64_t start = header.heap_location;
+    int64_t block = start;
+    for (unsigned int j = 1; j <= header.heap_blocks; j++)
+    {
+      int64_t next = j < header.heap_blocks ? get_next_block(block) : END_OF_CHAIN;
+      if (next != block + 1)
+      {
+        if (release_blocks(start, block - start + 1) != 0)
+        {
+          return -1;
+        }
+        start = next;
+      }
+      block = next;
+    }
+
+    if (release_blocks(header.location, 1) != 0)
+    {
+      return -1;
+    }
+  }
+  return 0;
+}
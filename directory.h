@@ -0,0 +1,177 @@
+/**************************************************************
+ * Class::  CSC-415-02 Spring 2024
+ * Name:: Thiha Aung, Min Ye Thway Khaing, Dylan Nguyen
+ * GitHub-Name:: thihaaung32
+ * Group-Name:: Bee
+ * Project:: Basic File System
+ *
+ * File:: directory.h
+ *
+ * Description:: Interface of the on-disk directory format.
+ *
+ *	A directory is a header block and a list of segments, each a
+ *	contiguous array of fixed-size record slots. Entries are placed in a segment
+ *	by a hash of their name with linear probing, so a name is found
+ *	or inserted by reading the slots on its probe chain in each
+ *	segment instead of scanning the whole directory.
+ *
+ *	A directory starts with one segment of DE_COUNT slots. When every
+ *	segment is past DIR_MAX_LOAD a new segment twice the size of the
+ *	last one is added, so existing entries never move and the number
+ *	of segments grows with the log of the entry count.
+ *
+ *	A record holds a name and the number of the inode with the
+ *	entry's metadata, so metadata changes never touch the directory.
+ *	Records keep names up to DIR_INLINE_NAME bytes inline. Longer
+ *	names go to the directory's name heap, a chain of blocks where
+ *	no name crosses a block boundary, and the record keeps their
+ *	offset. The record also keeps the name's hash, so most probes
+ *	are settled without comparing or reading the name.
+ *
+ *	Callers see entries as DirectoryEntry, records are converted
+ *	on the way in and out. An entry must have its inode before it
+ *	is inserted, and removing an entry leaves its inode alone.
+ *
+ *	Entry indexes handed out by these functions are 0 for ".",
+ *	1 for ".." and DE_FIRST_SLOT onwards for the slots, numbered
+ *	through the segments in order.
+ *
+ **************************************************************/
+
+#ifndef _DIRECTORY_H
+#define _DIRECTORY_H
+
+#include "structure.h"
+
+#define DIR_MAGIC 0x48524944 // "DIRH", marks a directory header block
+#define DIR_VERSION 4        // records point to inodes
+
+#define DIR_MAX_SEGMENTS 16 // segments a directory can grow to
+#define DIR_MAX_LOAD 75     // percent of a segment's slots in use before it is full
+
+#define DE_SELF 0       // index of the "." entry
+#define DE_PARENT 1     // index of the ".." entry
+#define DE_FIRST_SLOT 2 // index of the first slot
+
+#define DE_AVAILABLE 'a' // slot never used, ends a probe chain
+#define DE_REMOVED 'r'   // slot freed, probe chains continue past it
+
+#define DIR_INLINE_NAME 54 // longest name kept inside a record
+
+// This is the on-disk form of a directory entry, 64 bytes. The metadata
+// lives in the entry's inode
+typedef struct
+{
+  uint32_t inode;              // inode holding the metadata, see inode.h
+  uint32_t hash;               // dirHash of the name
+  char name[DIR_INLINE_NAME];  // short names, not terminated when full. Long
+                               // names keep their heap offset here instead
+  unsigned char attributes;    // attributes of file, or DE_AVAILABLE / DE_REMOVED
+  unsigned char name_len;      // length of the name without the terminator
+} DirRecord;
+
+// One contiguous run of slots
+typedef struct
+{
+  uint64_t location;       // block location of the first slot
+  unsigned int num_blocks; // blocks the slots occupy
+  unsigned int capacity;   // number of slots
+  unsigned int count;      // live entries
+  unsigned int tombstones; // removed slots
+} DirSegment;
+
+// This is the header at the first block of every directory, it must fit
+// in the smallest block size
+typedef struct
+{
+  uint32_t magic;            // DIR_MAGIC
+  uint32_t version;          // DIR_VERSION
+  uint64_t location;         // block location of this directory (".")
+  uint64_t parent;           // block location of the parent directory ("..")
+  unsigned int num_blocks;   // blocks the directory occupies, header included
+  unsigned int count;        // live entries in all segments
+  unsigned int segments;     // segments in use
+  uint64_t heap_location;    // first block of the name heap, 0 if none
+  unsigned int heap_blocks;  // blocks in the name heap
+  unsigned int heap_used;    // bytes of the name heap handed out
+  unsigned int heap_garbage; // bytes of removed names and block tails
+  time_t timeCreated;        // time directory was created
+  time_t timeLastModified;   // time an entry was last added or removed
+  time_t timeLastViewed;     // time directory was last accessed
+  DirSegment segment[DIR_MAX_SEGMENTS];
+} DirHeader;
+
+#define DIR_CURSOR_BATCH 64 // records a cursor reads per refill
+
+// Reads a directory front to back. The header is read once when the
+// cursor is opened and records are read a batch at a time, so listing a
+// directory costs one cache read per batch instead of one per entry.
+// The live counts in the header let the cursor leave a segment after
+// its last live record and stop after the directory's last one.
+typedef struct
+{
+  DirHeader header;         // header as of opening
+  DirHeader parentHeader;   // parent header, for ".."
+  int index;                // entry index of the next record to return
+  int batchStart;           // entry index of batch[0]
+  int batchCount;           // records in batch
+  int segmentEnd;           // entry index one past the batch's segment
+  unsigned int segmentLeft; // live records of that segment not returned yet
+  unsigned int left;        // live records of the directory not returned yet
+  DirRecord batch[DIR_CURSOR_BATCH];
+} DirCursor;
+
+// Geometry of a new directory for the mounted volume's block size. The
+// first segment holds at least DE_COUNT slots and uses any slack in its
+// last block.
+extern int dirBlocks;  // blocks occupied by a new directory
+extern int dirBytes;   // bytes occupied by a new directory
+extern int dirEntries; // slots in the first segment
+
+void initDirGeometry();
+
+// hash of a name, decides the slot an entry is placed in
+unsigned int dirHash(const char *name);
+
+// creates an empty directory, returns its location or -1
+int64_t initRootDirectory(uint64_t parent_location);
+
+int load_dir_header(uint64_t location, DirHeader *header);
+int write_dir_header(const DirHeader *header);
+
+// finds name in a directory, returns its index and fills in entry
+// (entry may be NULL), or -1 if the name is not there
+int get_de_index(uint64_t dir, const char *name, DirectoryEntry *entry);
+
+// reads the entry at index, 0 on success
+int read_de(uint64_t dir, int index, DirectoryEntry *entry);
+
+// reads the first live entry at or after *index and moves *index past
+// it, returns -1 once the directory is exhausted
+int next_de(uint64_t dir, int *index, DirectoryEntry *entry);
+
+// adds entry to a directory, growing it if it is full, returns its
+// index or -1. The record points at entry->inode
+int insert_de(uint64_t dir, const DirectoryEntry *entry);
+
+// adds count entries in order, reading and writing the header once.
+// Returns how many were added, -1 if the directory cannot be read
+int insert_de_batch(uint64_t dir, const DirectoryEntry *entries, int count);
+
+// removes name from a directory, 0 on success
+int remove_de(uint64_t dir, const char *name);
+
+// opens a cursor on a directory, 0 on success
+int open_dir_cursor(uint64_t dir, DirCursor *cursor);
+
+// reads the next live entry, -1 once the directory is exhausted
+int cursor_next(DirCursor *cursor, DirectoryEntry *entry);
+
+// points a directory's ".." at a new parent, used when it is moved
+int set_de_parent(uint64_t dir, uint64_t parent);
+
+// gives the header, segments and name heap of count directories taken
+// out of the tree back to the free chain, 0 on success
+int release_dirs(const uint64_t *locations, int count);
+
+#endif
@@ -14,241 +14,470 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
 #include "freeSpaceManagement.h"
 #include "fsLow.h"
 #include "mfs.h"
+#include "memo.h"
+#include "journal.h"
+
+#define MAP_FORMAT_BLOCKS 64  // map blocks built and written at a time when formatting
+
+// The tail of the free chain as runs of consecutive blocks, in chain
+// order, in a ring of FREE_EXTENT_WINDOW. allocateBlock takes blocks
+// from the tail, so the map itself is only read for links. The extents
+// before the window are found again from the chain when it runs dry.
+static FreeExtent *freeExtents = NULL;
+static int extentFirst = 0;       // ring index of the oldest extent
+static int extentCount = 0;       // extents in the window
+static uint64_t windowBlocks = 0; // blocks the window holds
+
+// the i-th extent of the window, 0 is the oldest
+static FreeExtent *extentAt(int i)
+  {
+  return &freeExtents[(extentFirst + i) % FREE_EXTENT_WINDOW];
+  }
 
-// Initialize the freespace bitmap as specified in the file system volume control block.
-int initializeFreeSpace()
-{
-  // Calculate the number of ints needed for the bitmap 
-  int bitmap_size = (myVCB->blockTotal + 31) / 32; 
-  bitmap = malloc(bitmap_size * sizeof(int)); // Allocate memory for the bitmap.
-  if (!bitmap) {
-    perror("Failed to allocate memory for freespace bitmap");
-    return -1;
+static void clearExtents()
+  {
+  extentFirst = 0;
+  extentCount = 0;
+  windowBlocks = 0;
   }
-  memset(bitmap, 0, bitmap_size * sizeof(int)); 
 
-  // Mark the first block (block 0) as written in the bitmap.
-  bitmap[0] |= 0x01;
+// Adds count blocks from start at the tail of the window. The oldest
+// extent makes room when the window is full, it stays on the chain.
+static int appendExtent(int64_t start, int64_t count)
+  {
+  if (freeExtents == NULL)
+    {
+    freeExtents = malloc(FREE_EXTENT_WINDOW * sizeof(FreeExtent));
+    if (freeExtents == NULL)
+      {
+      perror("Failed to allocate the free extents");
+      return -1;
+      }
+    }
 
-  // Initialize VCB with freespace management.
-  myVCB->freespace_size = bitmap_size;
-  myVCB->freeBlocks = myVCB->blockTotal - 1; 
+  windowBlocks += count;
+  if (extentCount > 0)
+    {
+    FreeExtent *last = extentAt(extentCount - 1);
+    if (last->start + last->count == start)
+      {
+      last->count += count;
+      return 0;
+      }
+    }
 
-  // Write the updated bitmap to disk.
-  int blocks_written = LBAwrite(bitmap, bitmap_size * sizeof(int), 1);
-  if (blocks_written != bitmap_size * sizeof(int))
-  {
-    perror("LBAwrite failed\n");
-    return -1;
+  if (extentCount == FREE_EXTENT_WINDOW)
+    {
+    windowBlocks -= extentAt(0)->count;
+    extentFirst = (extentFirst + 1) % FREE_EXTENT_WINDOW;
+    extentCount--;
+    }
+  FreeExtent *extent = extentAt(extentCount++);
+  extent->start = start;
+  extent->count = count;
+  return 0;
   }
 
-  return 1;  // Return success.
-}
+// writes a link into a piece of the map being built
+static void putLink(char *chunk, uint64_t index, int64_t next)
+  {
+  if (myVCB->mapLinkBytes == sizeof(int64_t))
+    {
+    ((int64_t *)chunk)[index] = next;
+    }
+  else
+    {
+    ((int32_t *)chunk)[index] = (int32_t)next;
+    }
+  }
 
-// Allocates the numberOfBlocks, and returns the first block of the allocation
-int allocateBlock(int numberOfBlocks)
+// Initialize the freespace map as specified in the file system volume control block.
+// The map holds one link per block to the next block of its chain, so
+// the free blocks form one chain starting at freeSpaceStartBlock.
+int initializeFreeSpace()
   {
-  
-  if (myVCB->freeBlocks < numberOfBlocks)
+  // links are as narrow as the volume allows, half the map of 64 bit
+  // ones for any volume an int can number
+  myVCB->mapLinkBytes = myVCB->blockTotal > INT32_MAX ? sizeof(int64_t) : sizeof(int32_t);
+
+  // Calculate the number of blocks needed for one link per volume block
+  myVCB->freespace_size = get_num_blocks(myVCB->mapLinkBytes * myVCB->blockTotal, myVCB->block_size);
+  myVCB->fsLocation = 1;
+
+  // block 0 holds the VCB and the map follows it
+  uint64_t first_free = 1 + myVCB->freespace_size;
+  uint64_t perBlock = myVCB->block_size / myVCB->mapLinkBytes;
+
+  // the map is built and written a piece at a time, it may be far
+  // bigger than the memory we want to spend on it
+  char *chunk = malloc(BLOCKS_TO_BYTES(MAP_FORMAT_BLOCKS));
+  if (chunk == NULL)
     {
-    perror("Not enough freespace available.\n");   
+    perror("Failed to allocate the freespace map\n");
     return -1;
     }
- 
-  int current_index = myVCB->freeSpaceStartBlock;
-  int next = bitmap[myVCB->freeSpaceStartBlock];
-  for (int i = 0; i < myVCB->freeBlocks - numberOfBlocks - 1; i++)
+
+  for (uint64_t mapBlock = 0; mapBlock < myVCB->freespace_size; mapBlock += MAP_FORMAT_BLOCKS)
     {
+    uint64_t count = myVCB->freespace_size - mapBlock;
+    if (count > MAP_FORMAT_BLOCKS)
+      {
+      count = MAP_FORMAT_BLOCKS;
+      }
 
-    current_index = next;
+    for (uint64_t i = 0; i < count * perBlock; i++)
+      {
+      uint64_t block = mapBlock * perBlock + i;
+
+      // the VCB, the map and the slack past the volume are never handed out,
+      // every other block is chained to the one after it
+      if (block < first_free || block >= myVCB->blockTotal - 1)
+        {
+        putLink(chunk, i, END_OF_CHAIN);
+        }
+      else
+        {
+        putLink(chunk, i, block + 1);
+        }
+      }
 
-    next = bitmap[next];
+    // Write the piece of the map to disk.
+    if (fs_LBAwrite(chunk, count, myVCB->fsLocation + mapBlock) != count)
+      {
+      perror("LBAwrite failed\n");
+      free(chunk);
+      return -1;
+      }
     }
+  free(chunk);
 
-  myVCB->freeBlocks = myVCB->freeBlocks - numberOfBlocks; // reduce available free space
+  // Initialize VCB with freespace management.
+  myVCB->freeSpaceStartBlock = first_free;
+  myVCB->freeBlocks = myVCB->blockTotal - first_free;
 
-  // return the index of the first block
-  return next;
+  clearExtents();
+  if (appendExtent(first_free, myVCB->freeBlocks) != 0)
+    {
+    return -1;
+    }
+
+  // the mount summary comes first out of the free space
+  int64_t summary = allocateBlock(1);
+  if (summary == -1)
+    {
+    return -1;
+    }
+  myVCB->summaryLocation = summary;
+
+  return myVCB->fsLocation;  // location of the freespace map
   }
 
-// loads the free space map on the drive 
-int load_free()
+// Allocates the numberOfBlocks, and returns the first block of the allocation
+int64_t allocateBlock(int numberOfBlocks)
   {
-  int readBlock = LBAread(bitmap, myVCB->freespace_size, 1);
 
-  if (readBlock  != myVCB->freespace_size)
+  if (numberOfBlocks < 1 || myVCB->freeBlocks < (uint64_t)numberOfBlocks)
     {
-    perror("LBAread failed to load momery.\n");
+    perror("Not enough freespace available.\n");
     return -1;
     }
 
-  return readBlock;
-  }
+  // the whole free chain is handed out
+  if (myVCB->freeBlocks == (uint64_t)numberOfBlocks)
+    {
+    int64_t first = myVCB->freeSpaceStartBlock;
+    myVCB->freeSpaceStartBlock = END_OF_CHAIN;
+    myVCB->freeBlocks = 0;
+    clearExtents();
+    return first;
+    }
 
-// get the block location from the block location provided to current position
-int get_block(long location, int offset)
-  {
-  long current_location = location;
-  long next = bitmap[current_location];
-  for (int i = 0; i < offset; i++)
+  // the block that becomes the new end of the chain must be in the window
+  if (windowBlocks <= (uint64_t)numberOfBlocks)
     {
-    current_location = next;
-    next = bitmap[next];
+    rebuild_free();
     }
-  return current_location;
-  }
 
-// get the block location from the location provided
-int get_next_block(long location)
-  {
-  return bitmap[location];
-  }
+  // a chain more fragmented than the window holds is walked instead
+  if (windowBlocks <= (uint64_t)numberOfBlocks)
+    {
+    int64_t end = get_block(myVCB->freeSpaceStartBlock,
+                            myVCB->freeBlocks - numberOfBlocks - 1);
+    int64_t first = get_next_block(end);
+    set_next_block(end, END_OF_CHAIN);
+    myVCB->freeBlocks -= numberOfBlocks;
+    rebuild_free();
+    return first;
+    }
 
+  // the tail of the free chain becomes the new allocation, already linked
+  // together and ending in END_OF_CHAIN. The extents tell where the tail
+  // starts without walking the chain.
+  int64_t needed = numberOfBlocks;
+  int64_t first = 0;
+  while (extentAt(extentCount - 1)->count <= needed)
+    {
+    needed -= extentAt(extentCount - 1)->count;
+    first = extentAt(extentCount - 1)->start;
+    extentCount--;
+    }
+
+  FreeExtent *last = extentAt(extentCount - 1);
+  last->count -= needed;
+  if (needed > 0)
+    {
+    first = last->start + last->count;
+    }
+  set_next_block(last->start + last->count - 1, END_OF_CHAIN);
 
+  windowBlocks -= numberOfBlocks;
+  myVCB->freeBlocks = myVCB->freeBlocks - numberOfBlocks; // reduce available free space
 
-int get_num_blocks(int bytes, int block_size)
-  {
-  return (bytes + block_size - 1)/(block_size);
+  // return the index of the first block
+  return first;
   }
 
-void write_fs(DirectoryEntry *dirArray)
+// Writes the mount summary, clean is 1 only once everything is home
+int write_summary(int clean)
   {
-  // write all changes to disk
-  if (LBAwrite(myVCB, 1, 0) != 1)
-		{
-		perror("LBAwrite failed when writing the VCB\n");
-		}
-	
-	if (LBAwrite(bitmap, myVCB->freespace_size, 1) != myVCB->freespace_size)
-		{
-		perror("LBAwrite failed when writing the freespace\n");
-		}
-	
-	if (LBAwrite(dirArray, dirArray[0].num_blocks, dirArray[0].location) != dirArray[0].num_blocks)
-		{
-		perror("LBAwrite failed when writing the directory\n");
-		}
+  char *block = calloc(1, myVCB->block_size);
+  if (block == NULL)
+    {
+    return -1;
+    }
+
+  MountSummary *summary = (MountSummary *)block;
+  summary->magic = SUMMARY_MAGIC;
+  summary->clean = clean;
+  summary->freeBlocks = myVCB->freeBlocks;
+  summary->freeSpaceStartBlock = myVCB->freeSpaceStartBlock;
+  summary->rootDirLocation = myVCB->rootDirLocation;
+
+  // as much of the tail as fits, which is a window of its own
+  int room = (myVCB->block_size - sizeof(MountSummary)) / sizeof(FreeExtent);
+  int skip = extentCount > room ? extentCount - room : 0;
+  summary->extentCount = extentCount - skip;
+  for (int i = skip; i < extentCount; i++)
+    {
+    summary->extents[i - skip] = *extentAt(i);
+    }
 
-  if (dirArray[0].location == cw_dir_array[0].location)
+  int result = fs_LBAwrite(block, 1, myVCB->summaryLocation) == 1 ? 0 : -1;
+  free(block);
+  if (result != 0)
     {
-    memcpy(cw_dir_array, dirArray, dirArray[0].size);
+    perror("LBAwrite failed when writing the mount summary\n");
     }
+  return result;
   }
 
-void write_dircetory(DirectoryEntry *dirArray)
+// Follows the free chain, keeping the extents at its tail
+int rebuild_free()
   {
-  // write changes to directory to disk
-	if (LBAwrite(dirArray, dirArray[0].num_blocks, dirArray[0].location) != dirArray[0].num_blocks)
-		{
-		perror("LBAwrite failed when writing the directory\n");
-		}
-
-  if (dirArray[0].location == cw_dir_array[0].location)
+  clearExtents();
+  int64_t block = myVCB->freeSpaceStartBlock;
+  for (uint64_t i = 0; i < myVCB->freeBlocks && block != END_OF_CHAIN; i++)
     {
-    memcpy(cw_dir_array, dirArray, dirArray[0].size);
+    if (appendExtent(block, 1) != 0)
+      {
+      return -1;
+      }
+    block = get_next_block(block);
     }
+  return 0;
   }
 
-
-// sets the current working path
-char *set_cwd()
+// Puts count consecutive blocks from start back at the end of the free
+// chain, for blocks nothing holds any more
+int release_blocks(int64_t start, int64_t count)
   {
-  // malloc DirectoryEntry array
-  int num_blocks = get_num_blocks(sizeof(DirectoryEntry) * DE_COUNT, myVCB->block_size);
-  int num_bytes = num_blocks * myVCB->block_size;
-  DirectoryEntry *dirArray = malloc(num_bytes);
+  char links[MAP_FORMAT_BLOCKS * 64];
+  int perWrite = sizeof(links) / myVCB->mapLinkBytes;
 
-  int token_count = 0;
-  // malloc an array of token pointers
-  char **token_array = malloc(MAX_PATH_LENGTH);  
+  // a cached copy must not be written over the blocks' next owner
+  invalidateBuffers(start, count);
 
-  // read the current working directory into memory
-  LBAread(dirArray, cw_dir_array[0].num_blocks, cw_dir_array[0].location);
+  // the run is linked together a piece of the map at a time
+  for (int64_t done = 0; done < count; done += perWrite)
+    {
+    int length = count - done < perWrite ? count - done : perWrite;
+    for (int i = 0; i < length; i++)
+      {
+      int64_t block = start + done + i;
+      putLink(links, i, block == start + count - 1 ? END_OF_CHAIN : block + 1);
+      }
+    if (cacheWriteBytes(links, myVCB->fsLocation, (start + done) * myVCB->mapLinkBytes,
+                        length * myVCB->mapLinkBytes) != 0)
+      {
+      perror("Failed to write the freespace map\n");
+      return -1;
+      }
+    }
 
-  if (dirArray[0].location == dirArray[1].location)
+  // the window always ends with the tail of a chain that is not empty
+  if (myVCB->freeBlocks == 0)
+    {
+    myVCB->freeSpaceStartBlock = start;
+    clearExtents();
+    }
+  else
     {
-    strcpy(get_cwd, "/");
-    return get_cwd;
+    FreeExtent *last = extentAt(extentCount - 1);
+    set_next_block(last->start + last->count - 1, start);
     }
 
-  // load the current directory 
-  int search_loc = dirArray[0].location;
-  int path_size = 0;
+  myVCB->freeBlocks += count;
+  return appendExtent(start, count);
+  }
 
-  // iterate until we reach the root directory
-  while (dirArray[0].location != dirArray[1].location)
+int clear_blocks(int64_t location, uint64_t blocks)
+  {
+  char *zero = calloc(MAP_FORMAT_BLOCKS, myVCB->block_size);
+  if (zero == NULL)
     {
-    // read the parent directory into memory 
-    LBAread(dirArray, dirArray[1].num_blocks, dirArray[1].location);
+    return -1;
+    }
 
-    // iterate through the currently loaded directory to find the location
-    for (int i = 2; i < DE_COUNT; i++)
+  int result = 0;
+  for (uint64_t done = 0; done < blocks && result == 0; done += MAP_FORMAT_BLOCKS)
+    {
+    uint64_t count = blocks - done < MAP_FORMAT_BLOCKS ? blocks - done : MAP_FORMAT_BLOCKS;
+    if (fs_LBAwrite(zero, count, location + done) != count)
       {
- 
-        if (dirArray[i].location == search_loc)
-          {
-          int name_size = strlen(dirArray[i].name) + 1;
-          path_size += name_size;
-          token_array[token_count] = malloc(name_size);
-          strcpy(token_array[token_count++], dirArray[i].name);
-          break;
-          }
+      perror("LBAwrite failed\n");
+      result = -1;
       }
-    
-    // set a new seach location as parent directory
-    search_loc = dirArray[0].location;
     }
+  free(zero);
+  return result;
+  }
 
-  char *path = malloc(path_size);
-
-  strcpy(path, "/");
-  for (int i = token_count - 1; i >= 0; i--)
+// loads the free extents from the mount summary. The map itself is read
+// a block at a time, when a link in it is first needed.
+int load_free()
+  {
+  char *block = malloc(myVCB->block_size);
+  if (block == NULL || fs_LBAread(block, 1, myVCB->summaryLocation) != 1)
     {
-    strcat(path, token_array[i]);
-
-    free(token_array[i]);
-    token_array[i] = NULL;
+    perror("LBAread failed to load the mount summary.\n");
+    free(block);
+    return -1;
+    }
+  MountSummary *summary = (MountSummary *)block;
+
+  // the summary counts only if the volume was unmounted cleanly since
+  // it was written
+  int usable = summary->magic == SUMMARY_MAGIC && summary->clean &&
+               summary->extentCount >= 0 &&
+               summary->freeBlocks == myVCB->freeBlocks &&
+               summary->freeSpaceStartBlock == myVCB->freeSpaceStartBlock &&
+               summary->rootDirLocation == myVCB->rootDirLocation &&
+               (summary->extentCount > 0 || summary->freeBlocks == 0);
+
+  int result = 0;
+  clearExtents();
+  if (usable)
+    {
+    for (int64_t i = 0; i < summary->extentCount && result == 0; i++)
+      {
+      result = appendExtent(summary->extents[i].start, summary->extents[i].count);
+      }
+    }
+  else
+    {
+    // an older format's summary is only out of date
+    if (summary->magic == SUMMARY_MAGIC)
+      {
+      printf("The volume was not unmounted cleanly, following the free chain\n");
+      }
+    result = rebuild_free();
+    }
+  free(block);
 
-    if (i > 0)
-      strcat(path, "/");
+  // until the next clean unmount the summary is out of date
+  if (result != 0 || write_summary(0) != 0)
+    {
+    return -1;
     }
+  return 0;
+  }
 
-  strcpy(get_cwd, path);
+// writes the clean summary at unmount and lets go of the extents
+void unload_free()
+  {
+  write_summary(1);
+  free(freeExtents);
+  freeExtents = NULL;
+  clearExtents();
+  }
 
-  free(dirArray);
-  dirArray = NULL;
-  free(token_array);
-  token_array = NULL;
-  free(path);
-  path = NULL;
+// get the block location from the block location provided to current position
+int64_t get_block(int64_t location, uint64_t offset)
+  {
+  int64_t current_location = location;
+  int64_t next = get_next_block(current_location);
+  for (uint64_t i = 0; i < offset && next != END_OF_CHAIN; i++)
+    {
+    current_location = next;
+    next = get_next_block(next);
+    }
+  return current_location;
   }
 
-// helper function to get the last token from a path
-char* get_last_token(const char *pathname)
+// get the block location from the location provided
+int64_t get_next_block(int64_t location)
   {
-  char *path = malloc(strlen(pathname) + 1);
-  strcpy(path, pathname);
-  char *mallo_array = malloc(sizeof(char) * 128);
-  char *last_token;
-  char *token = strtok_r(path, "/", &last_token);  
+  // a 4 byte link is widened, END_OF_CHAIN with it
+  int64_t next = 0;
+  int32_t narrow = 0;
+  void *link = myVCB->mapLinkBytes == sizeof(int64_t) ? (void *)&next : (void *)&narrow;
 
-  if (token == NULL)
+  if (cacheReadBytes(link, myVCB->fsLocation, location * myVCB->mapLinkBytes,
+                     myVCB->mapLinkBytes) != 0)
     {
-    strcpy(mallo_array, ".");
-    return mallo_array;
+    perror("Failed to read the freespace map\n");
+    return END_OF_CHAIN;
     }
+  return myVCB->mapLinkBytes == sizeof(int64_t) ? next : narrow;
+  }
 
-  while (token != NULL)
+// link the block at location to next
+void set_next_block(int64_t location, int64_t next)
+  {
+  int32_t narrow = (int32_t)next;
+  void *link = myVCB->mapLinkBytes == sizeof(int64_t) ? (void *)&next : (void *)&narrow;
+
+  if (cacheWriteBytes(link, myVCB->fsLocation, location * myVCB->mapLinkBytes,
+                      myVCB->mapLinkBytes) != 0)
     {
-    strcpy(mallo_array, token);
-    token = strtok_r(NULL, "/", &last_token);
+    perror("Failed to write the freespace map\n");
     }
+  }
+
+
+
+uint64_t get_num_blocks(uint64_t bytes, uint64_t block_size)
+  {
+  return (bytes + block_size - 1)/(block_size);
+  }
 
-  free(path);
-  path = NULL;
+void write_fs()
+  {
+  // the changes are committed with the journal's next group, and the
+  // home copies are written at its checkpoints
+  journalEndOp();
+  }
 
-  return mallo_array;
-  }
\ No newline at end of file
+void write_fs_home()
+  {
+  // write all changes to disk, the map is in the buffer cache
+  flushAllBuffers();
+  if (fs_LBAwrite(myVCB, 1, 0) != 1)
+		{
+		perror("LBAwrite failed when writing the VCB\n");
+		}
+  }
@@ -16,22 +16,69 @@
 
 #include "mfs.h"
 
+// marks the last block of a chain, and blocks that are never allocated
+#define END_OF_CHAIN -1
+
+#define SUMMARY_MAGIC 0x594D4D54  // "TMMY", marks the mount summary
+
+// Most extents of the free chain kept in memory. Only the tail of the
+// chain is needed to allocate, so memory stays the same however large
+// or fragmented the volume is.
+#define FREE_EXTENT_WINDOW 4096
+
+// A run of consecutive blocks of the free chain
+typedef struct
+  {
+  int64_t start;
+  int64_t count;
+  } FreeExtent;
+
+// Written to its block at unmount, so a mount can start allocating
+// without reading the map. While the volume is mounted clean is 0.
+typedef struct
+  {
+  uint32_t magic;                // SUMMARY_MAGIC
+  uint32_t clean;                // 1 if written by a clean unmount
+  uint64_t freeBlocks;           // copies of the VCB fields, the summary is used
+  uint64_t freeSpaceStartBlock;  // only if they still match
+  uint64_t rootDirLocation;
+  int64_t extentCount;           // extents at the tail of the chain that fit
+  FreeExtent extents[];          // the tail of the free chain in order
+  } MountSummary;
+
 int initializeFreeSpace();
-int allocateBlock(int numberOfBlocks);
+int64_t allocateBlock(int numberOfBlocks);
 int load_free();
-int get_block(long location, int offset);
-int get_next_block(long location);
+void unload_free();
+int write_summary(int clean);
+
+// Finds the extents at the tail of the free chain again by following it
+int rebuild_free();
+
+// Puts count consecutive blocks from start back on the free chain,
+// 0 on success
+int release_blocks(int64_t start, int64_t count);
+
+// Writes zeros over blocks consecutive blocks from location, a piece at
+// a time so a large region needs little memory. 0 on success.
+int clear_blocks(int64_t location, uint64_t blocks);
 
-int get_num_blocks(int bytes, int block_size);
+int64_t get_block(int64_t location, uint64_t offset);
 
-// Ensure the file changes are written back to disk
-void write_fs(DirectoryEntry *dirArray);
+// The map is read and written through the buffer cache one link at a
+// time, so only the blocks of it that are used are ever read. Links are
+// mapLinkBytes wide, 4 bytes unless the volume has more blocks than an
+// int can number.
+int64_t get_next_block(int64_t location);
+void set_next_block(int64_t location, int64_t next);
 
-// write changes of directory arry to disk
-void write_dircetory(DirectoryEntry *dirArray);
+uint64_t get_num_blocks(uint64_t bytes, uint64_t block_size);
 
-char *set_cwd();
+// A metadata operation is complete, its VCB and free space changes
+// go out with the next journal commit
+void write_fs();
 
-char* get_last_token(const char *pathname);
+// Write the VCB and the cached free space map to their home blocks
+void write_fs_home();
 
-#endif
\ No newline at end of file
+#endif
@@ -28,9 +28,10 @@
 
 
 VCB *myVCB;
-int *bitmap;
 char *get_cwd;
-DirectoryEntry *cw_dir_array;
+uint64_t cw_dir_location;
+
+static int mountedReadOnly = 0; // nothing is written back at exit
 
 // initialize volume control block
 void initVCB()
@@ -40,146 +41,129 @@ void initVCB()
   strncpy(myVCB->volumeName, "MyVolume", sizeof(myVCB->volumeName) - 1);
 }
 
-// Initialize a root directory including "." , ".."
-int initRootDirectory(int parent_location)
+// Reads the VCB. A version 9 one is brought to the current layout, the
+// rest of such a volume is read as it is and its map keeps 4 byte links.
+// Returns 1 if the VCB was upgraded, 0 if not and -1 on error.
+static int readVCB()
 {
-  // malloc a directory entry array
-  int num_blocks = get_num_blocks(sizeof(DirectoryEntry) * DE_COUNT, myVCB->block_size);
-  int numBytes = num_blocks * myVCB->block_size;
-  DirectoryEntry *dirArray = malloc(numBytes);
-
-  // allocate free space for the directory array
-  int dir_location = allocateBlock(num_blocks);
-
-  // Directory "." entry initialization
-  dirArray[0].size = numBytes;
-  dirArray[0].num_blocks = num_blocks;
-  dirArray[0].location = dir_location;
-  time_t curr_time = time(NULL);
-  dirArray[0].timeCreated = curr_time;
-  dirArray[0].timeLastModified = curr_time;
-  dirArray[0].timeLastViewed = curr_time;
-  dirArray[0].attributes = 'd';
-  strcpy(dirArray[0].name, ".");
-
-  // Parent directory ".." entry initialization
-  if (parent_location == 0)
-  {
-    // track number of blocks root directory has
-    myVCB->root_blocks = num_blocks;
-    dirArray[1].size = numBytes;
-    dirArray[1].num_blocks = num_blocks;
-    dirArray[1].location = dir_location;
-    dirArray[1].timeCreated = curr_time;
-    dirArray[1].timeLastModified = curr_time;
-    dirArray[1].timeLastViewed = curr_time;
-  }
-  else
+  if (fs_LBAread(myVCB, 1, 0) != 1)
   {
-    // load the parent directory to receive parent directory information
-    DirectoryEntry *parent_dir = malloc(numBytes);
-    if (LBAread(parent_dir, num_blocks, parent_location) != num_blocks)
-    {
-      perror("LBAread failed when reading parent directory.\n");
-      return -1;
-    }
-    dirArray[1].size = parent_dir->size;
-    dirArray[1].num_blocks = num_blocks;
-    dirArray[1].location = parent_location;
-    dirArray[1].timeCreated = parent_dir->timeCreated;
-    dirArray[1].timeLastModified = parent_dir->timeLastModified;
-    dirArray[1].timeLastViewed = parent_dir->timeLastViewed;
-
-    free(parent_dir);
-    parent_dir = NULL;
+    return -1;
   }
-
-  dirArray[1].attributes = 'd';
-  strcpy(dirArray[1].name, "..");
-
-  // set all other directory entries to available
-  for (int i = 2; i < DE_COUNT; i++)
+  if (myVCB->magic != OUR_SIGNATURE || myVCB->version != 9)
   {
-    dirArray[i].attributes = 'a';
+    return 0;
   }
 
-  // write new directory to disk
-  int blocks_written = LBAwrite(dirArray, num_blocks, dir_location);
+  VCBv9 old;
+  memcpy(&old, myVCB, sizeof(VCBv9));
+  memset(myVCB, 0, sizeof(VCB));
+
+  myVCB->blockTotal = old.blockTotal;
+  myVCB->fsLocation = old.fsLocation;
+  myVCB->freeSpaceStartBlock = old.freeSpaceStartBlock;
+  myVCB->freeBlocks = old.freeBlocks;
+  myVCB->magic = old.magic;
+  myVCB->signature = old.signature;
+  myVCB->mounting_time = old.mounting_time;
+  memcpy(myVCB->volumeName, old.volumeName, sizeof(myVCB->volumeName));
+  myVCB->version = FS_VERSION;
+  myVCB->block_size = old.block_size;
+  myVCB->freespace_size = old.freespace_size;
+  myVCB->rootDirLocation = old.rootDirLocation;
+  myVCB->root_blocks = old.root_blocks;
+  myVCB->inodeTableLocation = old.inodeTableLocation;
+  myVCB->inodeTableBlocks = old.inodeTableBlocks;
+  myVCB->inodeCount = old.inodeCount;
+  myVCB->inodeFree = old.inodeFree;
+  myVCB->inodeNext = old.inodeNext;
+  myVCB->mapLinkBytes = sizeof(int32_t);
+  myVCB->journalLocation = old.journalLocation;
+  myVCB->journalBlocks = old.journalBlocks;
+  myVCB->blockRefLocation = old.blockRefLocation;
+  myVCB->blockRefBlocks = old.blockRefBlocks;
+  myVCB->summaryLocation = old.summaryLocation;
+  return 1;
+}
 
-  if (blocks_written != num_blocks)
+// sets up the caches and the VCB buffer every mount needs
+static int initCaches(uint64_t blockSize)
+{
+  // offsets, copies and the buffer cache all work at the runtime block size
+  if (setBlockSize(blockSize) != 0 || initBuffers() != 0 || initDentryCache() != 0 ||
+      initDirBloom() != 0 || initDirIndex() != 0)
   {
-    perror("LBAwrite failed\n");
     return -1;
   }
 
-  free(dirArray);
-  dirArray = NULL;
-
-  // write updated free space to disk
-  if (LBAwrite(bitmap, myVCB->freespace_size, 1) != myVCB->freespace_size)
+  // Allocate space for the Volume Control Block
+  myVCB = malloc(blockSize);
+  if (!myVCB)
   {
-    perror("LBAwrite failed when trying to write the freespace\n");
+    perror("Failed to allocate VCB");
+    return -1;
   }
-
-  return dir_location;
+  return 0;
 }
 
-// helper function to receive the token in a directory entry array
-int get_de_index(char *token, DirectoryEntry *dirArray)
+// the current working directory starts at the root
+static int initCwd()
 {
-  for (int i = 0; i < DE_COUNT; i++)
-  {
-    if (strcmp(token, dirArray[i].name) == 0)
-    {
-      return i;
-    }
-  }
-  return -1;
-}
+  cw_dir_location = myVCB->rootDirLocation;
 
-// helper function to get the first available directory entry
-int get_avail_de_idx(DirectoryEntry *dirArray)
-{
-  for (int i = 2; i < DE_COUNT; i++)
+  // Allocate and set the path to root
+  get_cwd = malloc(MAX_PATH_LENGTH);
+  if (!get_cwd)
   {
-    if (dirArray[i].attributes == 'a')
-    {
-      return i;
-    }
+    perror("Failed to allocate get_cwd");
+    return -1;
   }
-  perror("No available space in directory\n");
-  return -1;
+  strcpy(get_cwd, "/");
+  return 0;
 }
 
 int initFileSystem(uint64_t numberOfBlocks, uint64_t blockSize)
 {
   printf("Initializing File System with %ld blocks with a block size of %ld\n", numberOfBlocks, blockSize);
 
-  // Allocate space for the Volume Control Block
-  myVCB = malloc(blockSize);
-  if (!myVCB)
+  mountedReadOnly = 0;
+  if (initCaches(blockSize) != 0)
   {
-    perror("Failed to allocate VCB");
     return -1;
   }
 
-  // the size needed for the bitmap and allocate
-  int numBitmapBlocks = get_num_blocks(sizeof(int) * numberOfBlocks, blockSize);
-  bitmap = malloc(numBitmapBlocks * blockSize);
-  if (!bitmap)
+  // Read VCB from the first block of the file system
+  int upgraded = readVCB();
+
+  if (upgraded == 1)
   {
-    perror("Failed to allocate bitmap");
-    free(myVCB);
-    return -1;
+    printf("Upgrading the volume from format version 9 to %d\n", FS_VERSION);
   }
 
-  // Read VCB from the first block of the file system
-  LBAread(myVCB, 1, 0);
-
   if (myVCB->magic == OUR_SIGNATURE)
   {
-    // File system exists, load existing free space configuration
-    if (load_free() != myVCB->freespace_size)
+    // volumes written in an older format are not readable by this code
+    if (myVCB->version != FS_VERSION)
+    {
+      printf("Volume format version %d is not supported, expected %d\n",
+             myVCB->version, FS_VERSION);
+      return -1;
+    }
+
+    initDirGeometry();
+
+    // bring the home blocks up to the last commit, the VCB with them. The
+    // journal of an older volume holds its own layout of the VCB, so the
+    // upgrade is done again on what it left.
+    if (replayJournal() != 0 || readVCB() == -1)
+    {
+      printf("Failed to replay the journal\n");
+      return -1;
+    }
+
+    // File system exists, load existing free space configuration. The
+    // map itself is read as it is used
+    if (load_free() != 0)
     {
       perror("Failed to load free space configuration");
       return -1;
@@ -191,6 +175,8 @@ int initFileSystem(uint64_t numberOfBlocks, uint64_t blockSize)
     myVCB->magic = OUR_SIGNATURE;
     myVCB->blockTotal = numberOfBlocks;
     myVCB->block_size = blockSize;
+    myVCB->version = FS_VERSION;
+    initDirGeometry();
 
     // Initialize the free space and root directory
     myVCB->fsLocation = initializeFreeSpace();
@@ -200,55 +186,127 @@ int initFileSystem(uint64_t numberOfBlocks, uint64_t blockSize)
       return -1;
     }
 
+    if (initInodeTable() != 0)
+    {
+      perror("Failed to initialize the inode table");
+      return -1;
+    }
+
+    if (initBlockRefs() != 0)
+    {
+      perror("Failed to initialize the block reference counts");
+      return -1;
+    }
+
+    if (initJournal() != 0)
+    {
+      perror("Failed to initialize the journal");
+      return -1;
+    }
+
     myVCB->rootDirLocation = initRootDirectory(0);
     if (myVCB->rootDirLocation == -1)
     {
       perror("Failed to initialize root directory");
       return -1;
     }
+
+    // a new volume starts with everything at home and an empty journal
+    write_fs_home();
+    if (write_summary(0) != 0)
+    {
+      return -1;
+    }
   }
 
   // Initialize the Volume Control Block
   initVCB();
-
-  // Allocate and read the current working directory array
-  cw_dir_array = malloc(myVCB->block_size * myVCB->root_blocks);
-  if (!cw_dir_array)
+  if (fs_LBAwrite(myVCB, 1, 0) != 1)
   {
-    perror("Failed to allocate cw_dir_array");
-    return -1;
+    perror("LBAwrite failed when writing the VCB\n");
   }
-  LBAread(cw_dir_array, myVCB->root_blocks, myVCB->rootDirLocation);
 
-  // Allocate and set the path to root
-  get_cwd = malloc(MAX_PATH_LENGTH);
-  if (!get_cwd)
+  if (startJournal() != 0 || initCwd() != 0)
   {
-    perror("Failed to allocate get_cwd");
     return -1;
   }
-  strcpy(get_cwd, "/");
 
   printf("Free Space Management system initialized.\n");
   return 0;
 }
 
+// Mounts an existing volume without writing to it. The journal is not
+// replayed, so a volume with committed transactions still waiting in it
+// is refused, and the free extents are not loaded, so nothing can be
+// allocated.
+int initFileSystemReadOnly(uint64_t numberOfBlocks, uint64_t blockSize)
+{
+  printf("Opening the file system read only, %ld blocks of %ld bytes\n", numberOfBlocks, blockSize);
+
+  mountedReadOnly = 1;
+  if (initCaches(blockSize) != 0)
+  {
+    return -1;
+  }
+
+  // a version 9 VCB is only brought up to date in memory
+  if (readVCB() == -1 || myVCB->magic != OUR_SIGNATURE)
+  {
+    printf("No file system found on the volume\n");
+    return -1;
+  }
+  if (myVCB->version != FS_VERSION)
+  {
+    printf("Volume format version %d is not supported, expected %d\n",
+           myVCB->version, FS_VERSION);
+    return -1;
+  }
+
+  initDirGeometry();
+
+  int pending = journalPending();
+  if (pending == -1)
+  {
+    printf("Failed to read the journal\n");
+    return -1;
+  }
+  if (pending > 0)
+  {
+    printf("The journal holds %d transactions not yet written home\n", pending);
+    return -1;
+  }
+
+  return initCwd();
+}
+
 void exitFileSystem()
 {
   printf("Exiting File System...\n");
 
-  flushAllBuffers();
-  closeAllOpenFiles();
-  writeBackMetadata();
+  // a read only mount changed nothing, its cached blocks are dropped
+  if (!mountedReadOnly)
+  {
+    // commit the last group and write everything home
+    stopJournal();
+    flushAllBuffers();
+    closeAllOpenFiles();
+    writeBackMetadata();
+
+    // everything is home, the next mount may trust the summary
+    unload_free();
+  }
 
   // Free allocated memory
-  free(bitmap);
+  freeBuffers();
+  freeDentryCache();
+  freeDirBloom();
+  freeDirIndex();
+  freeCwd();
 
   free(myVCB);
 
-  free(cw_dir_array);
-
   free(get_cwd);
 
-  printf("Files system changes saved and exited clearly.\n");
+  printf(mountedReadOnly ? "File system closed, nothing was written.\n"
+                         : "Files system changes saved and exited clearly.\n");
 }
@@ -0,0 +1,74 @@
+/**************************************************************
+ * Class::  CSC-415-02 Spring 2024
+ * Name:: Thiha Aung, Min Ye Thway Khaing, Dylan Nguyen
+ * GitHub-Name:: thihaaung32
+ * Group-Name:: Bee
+ * Project:: Basic File System
+ *
+ * File:: fsStats.c
+ *
+ * Description:: File system counters and the counted block layer
+ *            that sits between the file system and fsLow.
+ *
+ **************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include "fsLow.h"
+#include "fsStats.h"
+#include "structure.h"
+#include "memo.h"
+
+struct fs_stats fsStats;
+
+// read blocks from the volume and count the transfer
+uint64_t fs_LBAread(void *buffer, uint64_t lbaCount, uint64_t lbaPosition)
+{
+  uint64_t blocks = LBAread(buffer, lbaCount, lbaPosition);
+
+  STAT_INC(lba_reads);
+  STAT_ADD(blocks_read, blocks);
+
+  return blocks;
+}
+
+// write blocks to the volume and count the transfer
+uint64_t fs_LBAwrite(void *buffer, uint64_t lbaCount, uint64_t lbaPosition)
+{
+  uint64_t blocks = LBAwrite(buffer, lbaCount, lbaPosition);
+
+  STAT_INC(lba_writes);
+  STAT_ADD(blocks_written, blocks);
+
+  return blocks;
+}
+
+// interface to get a snapshot of the counters
+int fs_get_stats(struct fs_stats *buf)
+{
+  if (buf == NULL)
+  {
+    return -1;
+  }
+
+  memcpy(buf, &fsStats, sizeof(struct fs_stats));
+
+  // byte counts follow from the block counts, the VCB is not loaded
+  // yet when the first block is read so they are derived here
+  if (myVCB != NULL)
+  {
+    buf->bytes_read = buf->blocks_read * myVCB->block_size;
+    buf->bytes_written = buf->blocks_written * myVCB->block_size;
+  }
+
+  buf->cache_dirty = countDirtyBuffers();
+
+  return 0;
+}
+
+// interface to reset every counter back to zero
+void fs_reset_stats()
+{
+  memset(&fsStats, 0, sizeof(struct fs_stats));
+}
@@ -0,0 +1,97 @@
+/**************************************************************
+ * Class::  CSC-415-02 Spring 2024
+ * Name:: Thiha Aung, Min Ye Thway Khaing, Dylan Nguyen
+ * GitHub-Name:: thihaaung32
+ * Group-Name:: Bee
+ * Project:: Basic File System
+ *
+ * File:: fsStats.h
+ *
+ * Description:: Interface of the file system counters. Every layer
+ *            (block I/O, buffer cache, b_io and the directory code)
+ *            bumps these so the effect of a change can be measured.
+ *
+ **************************************************************/
+
+#ifndef _FS_STATS_H
+#define _FS_STATS_H
+
+#include <sys/types.h>
+
+#ifndef uint64_t
+typedef u_int64_t uint64_t;
+#endif
+
+// This is the structure that is filled in from a call to fs_get_stats
+struct fs_stats
+{
+  // block layer (every LBAread/LBAwrite the file system issues)
+  uint64_t lba_reads;      // number of LBAread calls
+  uint64_t lba_writes;     // number of LBAwrite calls
+  uint64_t blocks_read;    // blocks moved by LBAread
+  uint64_t blocks_written; // blocks moved by LBAwrite
+  uint64_t bytes_read;     // bytes moved by LBAread
+  uint64_t bytes_written;  // bytes moved by LBAwrite
+
+  // buffer cache (memo.c)
+  uint64_t cache_hits;      // blocks served from the cache
+  uint64_t cache_misses;    // blocks that had to be read from disk
+  uint64_t cache_evictions; // buffers reused for another block
+  uint64_t cache_writebacks; // dirty buffers written back to disk
+  uint64_t cache_dirty;     // dirty buffers right now (not reset)
+
+  // b_io
+  uint64_t file_opens;         // b_open calls
+  uint64_t file_closes;        // b_close calls
+  uint64_t file_reads;         // b_read calls
+  uint64_t file_writes;        // b_write calls
+  uint64_t file_bytes_read;    // bytes returned by b_read
+  uint64_t file_bytes_written; // bytes accepted by b_write
+  uint64_t file_promotions;    // inline files moved out to blocks
+  uint64_t file_clones;        // files cloned by sharing their blocks
+  uint64_t blocks_shared;      // blocks those clones shared
+  uint64_t cow_copies;         // shared blocks copied before a write
+  uint64_t blocks_freed;       // blocks given back by files that went away
+  uint64_t file_buffer_fills;  // file buffers filled from disk
+  uint64_t file_buffer_drains; // file buffers written out to disk
+  uint64_t file_syncs;         // b_fsync and b_fdatasync calls
+
+  // directory code (mfs.c, directory.c)
+  uint64_t path_lookups;     // resolveParentAt calls
+  uint64_t dir_reads;        // directory headers, slot batches and names read
+  uint64_t dir_writes;       // directory headers, slots and names written
+  uint64_t de_compares;      // directory entries compared by name
+  uint64_t dcache_hits;      // path components resolved by the dentry cache
+  uint64_t dcache_misses;    // path components looked up in a directory
+  uint64_t dcache_negatives; // dentry cache hits on names known to be missing
+  uint64_t dcache_resets;    // dentry cache emptied because its name arena filled
+  uint64_t bloom_rejects;    // lookups a directory filter answered "not there"
+  uint64_t bloom_builds;     // directory filters built by reading a directory
+  uint64_t index_builds;     // directory name indexes built by reading a directory
+  uint64_t inode_reads;      // inodes read, whole or their attributes
+  uint64_t inode_writes;     // inodes written
+
+  // journal
+  uint64_t journal_commits;     // transactions written to the journal
+  uint64_t journal_blocks;      // journal blocks those took
+  uint64_t journal_records;     // changes logged
+  uint64_t journal_checkpoints; // times the home blocks were brought up to date
+  uint64_t journal_replays;     // transactions applied at mount
+};
+
+extern struct fs_stats fsStats;
+
+#define STAT_INC(field) (fsStats.field++)
+#define STAT_ADD(field, n) (fsStats.field += (n))
+
+// Copies the current counters into buf
+int fs_get_stats(struct fs_stats *buf);
+
+// Zeros all counters (gauges such as cache_dirty are recomputed)
+void fs_reset_stats();
+
+// Counted block layer, use these instead of calling fsLow directly
+uint64_t fs_LBAread(void *buffer, uint64_t lbaCount, uint64_t lbaPosition);
+uint64_t fs_LBAwrite(void *buffer, uint64_t lbaCount, uint64_t lbaPosition);
+
+#endif
@@ -0,0 +1,917 @@
+/**************************************************************
+ * Class::  CSC-415-02 Spring 2024
+ * Name:: Thiha Aung, Min Ye Thway Khaing, Dylan Nguyen
+ * GitHub-Name:: thihaaung32
+ * Group-Name:: Bee
+ * Project:: Basic File System
+ *
+ * File:: fsWalk.c
+ *
+ * Description:: Tree walker and the recursive operations built on
+ *            it. Every directory of the tree is a task. Each worker
+ *            keeps its own deque of tasks and takes work from the
+ *            others when it runs dry, and a directory is finished
+ *            once all the tasks below it are.
+ *
+ **************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "mfs.h"
+#include "freeSpaceManagement.h"
+
+#define WALK_DEQUE_START 64 // tasks a deque holds before it grows
+#define WALK_COPY_BLOCKS 64 // longest run of blocks copied with one read and write
+
+// the file system core is single threaded, every call into it from the
+// pool holds this lock. The walk takes it only to read a directory, so
+// the workers' bookkeeping and the parts of visits that do not touch the
+// volume run side by side, while its reads and writes go one at a time
+static pthread_mutex_t walkLock = PTHREAD_MUTEX_INITIALIZER;
+
+// A directory waiting to be read or to be finished
+typedef struct WalkTask
+{
+  WalkItem item;           // the directory, item.path is malloc'd
+  struct WalkTask *parent; // directory holding it, NULL at the top
+  atomic_int pending;      // the directory's own scan and unfinished subdirectories
+  int visited;             // WALK_PRE went through, so WALK_POST is owed
+} WalkTask;
+
+// The owner takes the newest task so it works depth first, thieves take
+// the oldest, which is the largest subtree left
+typedef struct
+{
+  WalkTask **tasks;
+  int head;     // oldest task
+  int tail;     // one past the newest task
+  int capacity;
+  pthread_mutex_t lock;
+} WalkDeque;
+
+typedef struct
+{
+  WalkDeque *deques;
+  int threads;
+  fs_walk_fn visit;
+  void *arg;
+  atomic_int result;   // first nonzero visitor result, stops the walk
+  int outstanding;     // tasks pushed and not scanned yet
+  unsigned int pushes; // bumped on every push so idle workers notice
+  pthread_mutex_t idleLock;
+  pthread_cond_t idle;
+} WalkPool;
+
+typedef struct
+{
+  WalkPool *pool;
+  int id;            // index of the worker's own deque
+  DirCursor *cursor; // scratch cursor for the directories it reads
+  pthread_t thread;
+  int started;
+} WalkWorker;
+
+void fs_walk_lock()
+{
+  pthread_mutex_lock(&walkLock);
+}
+
+void fs_walk_unlock()
+{
+  pthread_mutex_unlock(&walkLock);
+}
+
+int fs_walk_threads()
+{
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+  if (cpus < 1)
+  {
+    return 1;
+  }
+  return cpus < WALK_MAX_THREADS ? cpus : WALK_MAX_THREADS;
+}
+
+static int dequePush(WalkDeque *deque, WalkTask *task)
+{
+  pthread_mutex_lock(&deque->lock);
+
+  if (deque->tail == deque->capacity)
+  {
+    // slide the tasks down before growing the array
+    if (deque->head > 0)
+    {
+      memmove(deque->tasks, deque->tasks + deque->head,
+              (deque->tail - deque->head) * sizeof(WalkTask *));
+      deque->tail -= deque->head;
+      deque->head = 0;
+    }
+    else
+    {
+      int capacity = deque->capacity ? deque->capacity * 2 : WALK_DEQUE_START;
+      WalkTask **tasks = realloc(deque->tasks, capacity * sizeof(WalkTask *));
+      if (tasks == NULL)
+      {
+        pthread_mutex_unlock(&deque->lock);
+        return -1;
+      }
+      deque->tasks = tasks;
+      deque->capacity = capacity;
+    }
+  }
+  deque->tasks[deque->tail++] = task;
+
+  pthread_mutex_unlock(&deque->lock);
+  return 0;
+}
+
+// the owner's end, NULL if the deque is empty
+static WalkTask *dequePopNewest(WalkDeque *deque)
+{
+  WalkTask *task = NULL;
+
+  pthread_mutex_lock(&deque->lock);
+  if (deque->tail > deque->head)
+  {
+    task = deque->tasks[--deque->tail];
+  }
+  pthread_mutex_unlock(&deque->lock);
+  return task;
+}
+
+// the thieves' end, NULL if the deque is empty
+static WalkTask *dequePopOldest(WalkDeque *deque)
+{
+  WalkTask *task = NULL;
+
+  pthread_mutex_lock(&deque->lock);
+  if (deque->tail > deque->head)
+  {
+    task = deque->tasks[deque->head++];
+  }
+  pthread_mutex_unlock(&deque->lock);
+  return task;
+}
+
+// join a directory's path and the name of an entry in it
+static char *walkPath(const char *dir, const char *name)
+{
+  size_t length = strlen(dir);
+  char *path = malloc(length + strlen(name) + 2);
+
+  if (path != NULL)
+  {
+    int slash = length > 0 && dir[length - 1] != '/';
+    sprintf(path, slash ? "%s/%s" : "%s%s", dir, name);
+  }
+  return path;
+}
+
+// keep the first nonzero result, the workers stop once there is one
+static void walkFail(WalkPool *pool, int result)
+{
+  int none = 0;
+
+  if (result != 0)
+  {
+    atomic_compare_exchange_strong(&pool->result, &none, result);
+  }
+}
+
+// the next entry of a directory, a cursor refills its batch and reads
+// each entry's inode through the buffer cache, under the walk's lock
+static int walkNext(DirCursor *cursor, DirectoryEntry *entry)
+{
+  pthread_mutex_lock(&walkLock);
+  int result = cursor_next(cursor, entry);
+  pthread_mutex_unlock(&walkLock);
+  return result;
+}
+
+static int walkPush(WalkPool *pool, int id, WalkTask *task)
+{
+  // counted before anyone can take it, so the walk cannot look finished
+  pthread_mutex_lock(&pool->idleLock);
+  pool->outstanding++;
+  pthread_mutex_unlock(&pool->idleLock);
+
+  int result = dequePush(&pool->deques[id], task);
+
+  pthread_mutex_lock(&pool->idleLock);
+  if (result == 0)
+  {
+    pool->pushes++;
+    pthread_cond_signal(&pool->idle);
+  }
+  else
+  {
+    pool->outstanding--;
+  }
+  pthread_mutex_unlock(&pool->idleLock);
+
+  return result;
+}
+
+// drop a reference to a task, finishing it and any directories above it
+// that were only waiting on it
+static void walkFinish(WalkPool *pool, WalkTask *task)
+{
+  while (task != NULL && atomic_fetch_sub(&task->pending, 1) == 1)
+  {
+    WalkTask *parent = task->parent;
+
+    if (task->visited)
+    {
+      walkFail(pool, pool->visit(&task->item, WALK_POST, pool->arg));
+    }
+
+    free((char *)task->item.path);
+    free(task);
+    task = parent;
+  }
+}
+
+// read a directory, visiting its files and queueing its subdirectories
+static void walkScan(WalkWorker *worker, WalkTask *task)
+{
+  WalkPool *pool = worker->pool;
+  DirCursor *cursor = worker->cursor;
+
+  if (pool->result == 0)
+  {
+    pthread_mutex_lock(&walkLock);
+    int failed = open_dir_cursor(task->item.entry.location, cursor) != 0;
+    pthread_mutex_unlock(&walkLock);
+
+    if (failed)
+    {
+      printf("Cannot read directory %s\n", task->item.path);
+      walkFail(pool, -1);
+    }
+  }
+
+  if (pool->result == 0)
+  {
+    // a directory's size is kept in its own header since it grows
+    task->item.entry.num_blocks = cursor->header.num_blocks;
+    task->item.entry.size = (uint64_t)cursor->header.num_blocks * myVCB->block_size;
+
+    int result = pool->visit(&task->item, WALK_PRE, pool->arg);
+    task->visited = result == 0;
+    walkFail(pool, result);
+  }
+
+  // the lock is let go between entries, so the workers take turns
+  // reading their directories and visiting their entries
+  DirectoryEntry entry;
+  while (pool->result == 0 && walkNext(cursor, &entry) == 0)
+  {
+    if (strcmp(entry.name, ".") == 0 || strcmp(entry.name, "..") == 0)
+    {
+      continue;
+    }
+
+    WalkItem item;
+    item.path = walkPath(task->item.path, entry.name);
+    item.depth = task->item.depth + 1;
+    item.parent = task->item.entry.location;
+    item.entry = entry;
+    item.parentData = task->item.data;
+    item.data = NULL;
+
+    if (item.path == NULL)
+    {
+      walkFail(pool, -1);
+      break;
+    }
+
+    if (entry.attributes != 'd')
+    {
+      walkFail(pool, pool->visit(&item, WALK_FILE, pool->arg));
+      free((char *)item.path);
+      continue;
+    }
+
+    WalkTask *child = malloc(sizeof(WalkTask));
+    if (child == NULL)
+    {
+      free((char *)item.path);
+      walkFail(pool, -1);
+      break;
+    }
+    child->item = item;
+    child->parent = task;
+    child->visited = 0;
+    atomic_init(&child->pending, 1);
+
+    atomic_fetch_add(&task->pending, 1);
+    if (walkPush(pool, worker->id, child) != 0)
+    {
+      // never read, so finishing it only hands its reference back
+      perror("fs_walk: task deque malloc failed");
+      walkFinish(pool, child);
+      walkFail(pool, -1);
+    }
+  }
+
+  walkFinish(pool, task);
+
+  pthread_mutex_lock(&pool->idleLock);
+  if (--pool->outstanding == 0)
+  {
+    pthread_cond_broadcast(&pool->idle);
+  }
+  pthread_mutex_unlock(&pool->idleLock);
+}
+
+static void *walkWorker(void *data)
+{
+  WalkWorker *worker = data;
+  WalkPool *pool = worker->pool;
+
+  while (1)
+  {
+    pthread_mutex_lock(&pool->idleLock);
+    unsigned int seen = pool->pushes;
+    pthread_mutex_unlock(&pool->idleLock);
+
+    // own work first, then steal from the others
+    WalkTask *task = dequePopNewest(&pool->deques[worker->id]);
+    for (int i = 1; task == NULL && i < pool->threads; i++)
+    {
+      task = dequePopOldest(&pool->deques[(worker->id + i) % pool->threads]);
+    }
+
+    if (task != NULL)
+    {
+      walkScan(worker, task);
+      continue;
+    }
+
+    // nothing to take, wait for a push or for the walk to end
+    pthread_mutex_lock(&pool->idleLock);
+    while (pool->outstanding > 0 && pool->pushes == seen)
+    {
+      pthread_cond_wait(&pool->idle, &pool->idleLock);
+    }
+    int done = pool->outstanding == 0;
+    pthread_mutex_unlock(&pool->idleLock);
+
+    if (done)
+    {
+      return NULL;
+    }
+  }
+}
+
+int fs_walk(const char *path, int threads, fs_walk_fn visit, void *arg)
+{
+  if (threads < 1)
+  {
+    threads = fs_walk_threads();
+  }
+  if (threads > WALK_MAX_THREADS)
+  {
+    threads = WALK_MAX_THREADS;
+  }
+
+  pthread_mutex_lock(&walkLock);
+
+  Dentry dentry;
+  DirectoryEntry entry;
+  if (lookupPath(path, &dentry) != 0 || read_de(dentry.parent, dentry.index, &entry) != 0)
+  {
+    pthread_mutex_unlock(&walkLock);
+    printf("%s is not found\n", path);
+    return -1;
+  }
+
+  WalkItem item;
+  item.path = path;
+  item.depth = 0;
+  item.parent = dentry.parent;
+  item.entry = entry;
+  item.parentData = NULL;
+  item.data = NULL;
+
+  pthread_mutex_unlock(&walkLock);
+
+  // a file is the whole tree
+  if (entry.attributes != 'd')
+  {
+    return visit(&item, WALK_FILE, arg);
+  }
+
+  WalkPool pool;
+  pool.deques = calloc(threads, sizeof(WalkDeque));
+  pool.threads = threads;
+  pool.visit = visit;
+  pool.arg = arg;
+  atomic_init(&pool.result, 0);
+  pool.outstanding = 0;
+  pool.pushes = 0;
+  pthread_mutex_init(&pool.idleLock, NULL);
+  pthread_cond_init(&pool.idle, NULL);
+
+  WalkWorker *workers = calloc(threads, sizeof(WalkWorker));
+  WalkTask *top = malloc(sizeof(WalkTask));
+  int failed = pool.deques == NULL || workers == NULL || top == NULL;
+
+  for (int i = 0; !failed && i < threads; i++)
+  {
+    pthread_mutex_init(&pool.deques[i].lock, NULL);
+    workers[i].pool = &pool;
+    workers[i].id = i;
+    workers[i].cursor = malloc(sizeof(DirCursor));
+    failed = workers[i].cursor == NULL;
+  }
+
+  if (!failed)
+  {
+    item.path = strdup(path);
+    top->item = item;
+    top->parent = NULL;
+    top->visited = 0;
+    atomic_init(&top->pending, 1);
+    failed = top->item.path == NULL;
+  }
+
+  if (failed)
+  {
+    perror("fs_walk: malloc failed");
+    pool.result = -1;
+    free(top);
+  }
+  else if (walkPush(&pool, 0, top) != 0)
+  {
+    perror("fs_walk: task deque malloc failed");
+    pool.result = -1;
+    free((char *)top->item.path);
+    free(top);
+  }
+  else
+  {
+    // the calling thread is worker 0, a worker that fails to start
+    // just leaves its share to the others
+    for (int i = 1; i < threads; i++)
+    {
+      workers[i].started = pthread_create(&workers[i].thread, NULL,
+                                          walkWorker, &workers[i]) == 0;
+    }
+    walkWorker(&workers[0]);
+    for (int i = 1; i < threads; i++)
+    {
+      if (workers[i].started)
+      {
+        pthread_join(workers[i].thread, NULL);
+      }
+    }
+  }
+
+  for (int i = 0; workers != NULL && i < threads; i++)
+  {
+    free(workers[i].cursor);
+  }
+  for (int i = 0; pool.deques != NULL && i < threads; i++)
+  {
+    free(pool.deques[i].tasks);
+    pthread_mutex_destroy(&pool.deques[i].lock);
+  }
+  free(workers);
+  free(pool.deques);
+  pthread_mutex_destroy(&pool.idleLock);
+  pthread_cond_destroy(&pool.idle);
+
+  return atomic_load(&pool.result);
+}
+
+// Directories taken out by rm -r. Their blocks are freed once the walk
+// is over, so the journal is checkpointed once for all of them
+typedef struct
+{
+  uint64_t *dirs;
+  int count;
+  int capacity;
+} RemoveTree;
+
+// A tree is taken apart from the bottom. Every entry leaves its
+// directory before its inode is freed, and a directory only goes once it
+// is empty, so a walk stopped by an error leaves whole entries behind.
+// Files let go of their blocks, directories are dropped from the dentry
+// cache and the filters.
+static int removeEntry(WalkItem *item, int event, RemoveTree *tree)
+{
+  if (event == WALK_POST)
+  {
+    // entries the walk did not get to keep the directory
+    DirHeader header;
+    if (load_dir_header(item->entry.location, &header) != 0)
+    {
+      return -1;
+    }
+    if (header.count > 0)
+    {
+      return 0;
+    }
+
+    if (tree->count == tree->capacity)
+    {
+      int capacity = tree->capacity ? tree->capacity * 2 : WALK_DEQUE_START;
+      uint64_t *dirs = realloc(tree->dirs, capacity * sizeof(uint64_t));
+      if (dirs == NULL)
+      {
+        return -1;
+      }
+      tree->dirs = dirs;
+      tree->capacity = capacity;
+    }
+  }
+
+  dcacheRemove(item->parent, item->entry.name);
+  if (remove_de(item->parent, item->entry.name) != 0)
+  {
+    return -1;
+  }
+
+  if (event == WALK_POST)
+  {
+    dcachePurgeDir(item->entry.location);
+    bloomDrop(item->entry.location);
+    dirIndexDrop(item->entry.location);
+    tree->dirs[tree->count++] = item->entry.location;
+  }
+  else if (item->entry.num_blocks > 0)
+  {
+    release_chain(item->entry.location, item->entry.num_blocks);
+  }
+  free_inode(item->entry.inode);
+  return 0;
+}
+
+static int removeVisit(WalkItem *item, int event, void *arg)
+{
+  if (event == WALK_PRE)
+  {
+    return 0;
+  }
+
+  fs_walk_lock();
+  int result = removeEntry(item, event, arg);
+  fs_walk_unlock();
+  return result;
+}
+
+int fs_remove_tree(const char *path, int threads)
+{
+  // "." and ".." name a directory from inside it
+  Dentry dentry;
+  if (lookupPath(path, &dentry) != 0 || dentry.index < DE_FIRST_SLOT)
+  {
+    printf("Cannot remove %s\n", path);
+    return -1;
+  }
+
+  // the blocks of a removed directory are reused
+  if (dentry.attributes == 'd' && cwdInside(dentry.location))
+  {
+    printf("Cannot remove %s, the working directory is inside it\n", path);
+    return -1;
+  }
+
+  RemoveTree tree;
+  memset(&tree, 0, sizeof(RemoveTree));
+
+  int result = fs_walk(path, threads, removeVisit, &tree);
+  if (release_dirs(tree.dirs, tree.count) != 0 && result == 0)
+  {
+    result = -1;
+  }
+  free(tree.dirs);
+  write_fs();
+
+  return result;
+}
+
+// A directory of the copy and the files it gets once everything below
+// it was copied, so they are written with a single batch. Directories go
+// into their parent as soon as they are made, so all a failed copy made
+// is found from its top
+typedef struct
+{
+  uint64_t location;
+  DirectoryEntry *entries;
+  int count;
+  int capacity;
+} CopyDir;
+
+typedef struct
+{
+  uint64_t destParent; // directory the copy goes into
+  const char *destName; // name of the copy
+  int clone;            // files share their blocks instead of copying them
+  int made;             // the top of the copy is in destParent
+} CopyTree;
+
+// copy a file's blocks to a new chain, whole runs at a time where both
+// chains are consecutive
+static int copyFileData(const DirectoryEntry *src, DirectoryEntry *copy)
+{
+  time_t now = time(NULL);
+  *copy = *src;
+  copy->timeCreated = now;
+  copy->timeLastModified = now;
+  copy->timeLastViewed = now;
+
+  // an inline file has no blocks, its data goes with the inode
+  if (src->num_blocks == 0)
+  {
+    return 0;
+  }
+
+  int64_t location = allocateBlock(src->num_blocks);
+  if (location == -1)
+  {
+    return -1;
+  }
+
+  char *buf = malloc((uint64_t)WALK_COPY_BLOCKS * myVCB->block_size);
+  if (buf == NULL)
+  {
+    release_chain(location, src->num_blocks);
+    return -1;
+  }
+
+  uint64_t used = (src->size + myVCB->block_size - 1) / myVCB->block_size;
+  long from = src->location;
+  long to = location;
+
+  while (used > 0 && from != END_OF_CHAIN && to != END_OF_CHAIN)
+  {
+    uint64_t run = 1;
+    while (run < used && run < WALK_COPY_BLOCKS &&
+           get_next_block(from + run - 1) == from + run &&
+           get_next_block(to + run - 1) == to + run)
+    {
+      run++;
+    }
+
+    if (fs_LBAread(buf, run, from) != run || fs_LBAwrite(buf, run, to) != run)
+    {
+      free(buf);
+      release_chain(location, src->num_blocks);
+      return -1;
+    }
+
+    from = get_next_block(from + run - 1);
+    to = get_next_block(to + run - 1);
+    used -= run;
+  }
+  free(buf);
+
+  copy->location = location;
+  return 0;
+}
+
+// a snapshot keeps the metadata of the file as it was and shares its
+// blocks, nothing is copied until one of the two is written
+static int cloneFileData(const DirectoryEntry *src, DirectoryEntry *copy)
+{
+  *copy = *src;
+  if (src->num_blocks == 0)
+  {
+    return 0;
+  }
+
+  if (share_chain(src->location, src->num_blocks) != 0)
+  {
+    return -1;
+  }
+  STAT_INC(file_clones);
+  return 0;
+}
+
+// undo a copied entry that never got into a directory, its inode is
+// freed by the caller
+static void dropCopy(const DirectoryEntry *copy)
+{
+  if (copy->attributes == 'd')
+  {
+    release_dirs(&copy->location, 1);
+  }
+  else if (copy->num_blocks > 0)
+  {
+    release_chain(copy->location, copy->num_blocks);
+  }
+}
+
+static int copyEntry(WalkItem *item, int event, void *arg)
+{
+  CopyTree *tree = arg;
+  CopyDir *parent = item->parentData;
+
+  if (event == WALK_POST)
+  {
+    // files the directory has no room for are undone
+    CopyDir *dir = item->data;
+    int added = insert_de_batch(dir->location, dir->entries, dir->count);
+    for (int i = added < 0 ? 0 : added; i < dir->count; i++)
+    {
+      free_inode(dir->entries[i].inode);
+      dropCopy(&dir->entries[i]);
+    }
+    int result = added == dir->count ? 0 : -1;
+    free(dir->entries);
+    free(dir);
+    return result;
+  }
+
+  uint64_t destParent = item->depth == 0 ? tree->destParent : parent->location;
+  DirectoryEntry copy;
+
+  if (event == WALK_FILE)
+  {
+    int result = tree->clone ? cloneFileData(&item->entry, &copy)
+                             : copyFileData(&item->entry, &copy);
+    if (result != 0)
+    {
+      return -1;
+    }
+  }
+  else
+  {
+    int64_t location = initRootDirectory(destParent);
+    if (location == -1)
+    {
+      return -1;
+    }
+
+    time_t now = time(NULL);
+    memset(&copy, 0, sizeof(DirectoryEntry));
+    strcpy(copy.name, item->entry.name);
+    copy.size = dirBytes;
+    copy.num_blocks = dirBlocks;
+    copy.location = location;
+    copy.timeCreated = now;
+    copy.timeLastModified = now;
+    copy.timeLastViewed = now;
+    copy.attributes = 'd';
+  }
+
+  if (alloc_inode(&copy) != 0)
+  {
+    dropCopy(&copy);
+    return -1;
+  }
+
+  if (event == WALK_FILE && copy.num_blocks == 0)
+  {
+    char data[INODE_INLINE_BYTES];
+    if (read_inline_data(item->entry.inode, data, copy.size) != 0 ||
+        write_inline_data(copy.inode, data, copy.size) != 0)
+    {
+      free_inode(copy.inode);
+      dropCopy(&copy);
+      return -1;
+    }
+  }
+
+  // the top and every directory go straight into their parent, files
+  // wait for the batch of the directory holding them
+  if (item->depth == 0 || event == WALK_PRE)
+  {
+    if (item->depth == 0)
+    {
+      strcpy(copy.name, tree->destName);
+    }
+    int index = insert_de(destParent, &copy);
+    if (index == -1)
+    {
+      free_inode(copy.inode);
+      dropCopy(&copy);
+      return -1;
+    }
+    if (item->depth == 0)
+    {
+      dcacheInsert(destParent, copy.name, index, &copy);
+      tree->made = 1;
+    }
+  }
+  else
+  {
+    if (parent->count == parent->capacity)
+    {
+      int capacity = parent->capacity ? parent->capacity * 2 : DIR_CURSOR_BATCH;
+      DirectoryEntry *entries = realloc(parent->entries, capacity * sizeof(DirectoryEntry));
+      if (entries == NULL)
+      {
+        free_inode(copy.inode);
+        dropCopy(&copy);
+        return -1;
+      }
+      parent->entries = entries;
+      parent->capacity = capacity;
+    }
+    parent->entries[parent->count++] = copy;
+  }
+
+  // a directory without its CopyDir stays empty, it is in its parent
+  if (event == WALK_PRE)
+  {
+    CopyDir *dir = calloc(1, sizeof(CopyDir));
+    if (dir == NULL)
+    {
+      return -1;
+    }
+    dir->location = copy.location;
+    item->data = dir;
+  }
+  return 0;
+}
+
+// every step of a copy reads or writes the file system, and entries of
+// a directory are gathered from several workers, so it runs under the lock
+static int copyVisit(WalkItem *item, int event, void *arg)
+{
+  fs_walk_lock();
+  int result = copyEntry(item, event, arg);
+  fs_walk_unlock();
+  return result;
+}
+
+static int copyTree(const char *src, const char *dest, int threads, int clone)
+{
+  ParsedPath path;
+  if (parsePath(dest, &path) != 0)
+  {
+    return -1;
+  }
+
+  long destParent = resolveParent(&path);
+  const char *destName = pathLast(&path);
+  if (destParent == -1 || strcmp(destName, ".") == 0 || strcmp(destName, "..") == 0)
+  {
+    printf("Invalid path: %s\n", dest);
+    return -1;
+  }
+  if (get_de_index(destParent, destName, NULL) != -1)
+  {
+    printf("%s already exists\n", dest);
+    return -1;
+  }
+
+  Dentry source;
+  if (lookupPath(src, &source) != 0)
+  {
+    printf("%s is not found\n", src);
+    return -1;
+  }
+
+  // a copy inside its own source would be walked as it grows
+  if (source.attributes == 'd')
+  {
+    uint64_t dir = destParent;
+    DirHeader header;
+    while (dir != source.location && dir != myVCB->rootDirLocation &&
+           load_dir_header(dir, &header) == 0)
+    {
+      dir = header.parent;
+    }
+    if (dir == source.location)
+    {
+      printf("Cannot copy %s into itself\n", src);
+      return -1;
+    }
+  }
+
+  CopyTree tree;
+  tree.destParent = destParent;
+  tree.destName = destName;
+  tree.clone = clone;
+  tree.made = 0;
+
+  int result = fs_walk(src, threads, copyVisit, &tree);
+  write_fs();
+
+  // a copy that stopped partway is taken apart, with the shares it took
+  if (result != 0 && tree.made)
+  {
+    printf("Removing the partial copy %s\n", dest);
+    fs_remove_tree(dest, threads);
+  }
+
+  return result;
+}
+
+int fs_copy_tree(const char *src, const char *dest, int threads)
+{
+  return copyTree(src, dest, threads, 0);
+}
+
+int fs_snapshot_tree(const char *src, const char *dest, int threads)
+{
+  return copyTree(src, dest, threads, 1);
+}
@@ -0,0 +1,73 @@
+/**************************************************************
+ * Class::  CSC-415-02 Spring 2024
+ * Name:: Thiha Aung, Min Ye Thway Khaing, Dylan Nguyen
+ * GitHub-Name:: thihaaung32
+ * Group-Name:: Bee
+ * Project:: Basic File System
+ *
+ * File:: fsWalk.h
+ *
+ * Description:: Interface of the tree walker. A walk hands every
+ *            entry below a path to a visitor, with the directories
+ *            spread over a pool of worker threads. The buffer cache,
+ *            the allocator and the directory code are not thread
+ *            safe, so every call into them holds one lock. The pool
+ *            overlaps the scheduling and the visitors' own work, the
+ *            reads and writes of the volume are serial.
+ *
+ **************************************************************/
+
+#ifndef _FS_WALK_H
+#define _FS_WALK_H
+
+#include "structure.h"
+
+#define WALK_MAX_THREADS 16 // most workers a walk runs
+
+// Events handed to a walk visitor
+#define WALK_FILE 0 // a file
+#define WALK_PRE 1  // a directory, before anything inside it
+#define WALK_POST 2 // a directory, after everything inside it
+
+// One entry of the tree being walked
+typedef struct
+{
+  const char *path;     // path of the entry, starting with the walked path
+  int depth;            // 0 for the walked path itself
+  uint64_t parent;      // location of the directory holding the entry
+  DirectoryEntry entry; // the entry, a directory's size is read from its header
+  void *parentData;     // data the visitor set on the directory holding it
+  void *data;           // set on WALK_PRE, handed back on WALK_POST
+} WalkItem;
+
+// Called for every entry. Visitors run on all the workers at once, one
+// holds fs_walk_lock while it calls into the file system or changes
+// data other visits share, such as its parentData. A nonzero return
+// stops the walk and becomes its result.
+typedef int (*fs_walk_fn)(WalkItem *item, int event, void *arg);
+
+// The lock that guards the file system while a walk runs
+void fs_walk_lock();
+void fs_walk_unlock();
+
+// Walks the tree at path with threads workers, 0 for one per CPU.
+// Directories get WALK_PRE before their entries and WALK_POST once all
+// of them were visited, files get WALK_FILE. Returns 0, -1 if the path
+// does not exist or the first nonzero visitor result.
+int fs_walk(const char *path, int threads, fs_walk_fn visit, void *arg);
+
+// Workers a walk runs when asked for 0
+int fs_walk_threads();
+
+// rm -r, removes path and everything below it
+int fs_remove_tree(const char *path, int threads);
+
+// cp -r, copies the tree at src to the new path dest
+int fs_copy_tree(const char *src, const char *dest, int threads);
+
+// Snapshot of the tree at src as the new path dest. Files share their
+// blocks with the source and keep its metadata, so only directories and
+// inodes are written.
+int fs_snapshot_tree(const char *src, const char *dest, int threads);
+
+#endif
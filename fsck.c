@@ -0,0 +1,766 @@
+/**************************************************************
+ * Class::  CSC-415-02 Spring 2024
+ * Name:: Thiha Aung, Min Ye Thway Khaing, Dylan Nguyen
+ * GitHub-Name:: thihaaung32
+ * Group-Name:: Bee
+ * Project:: Basic File System
+ *
+ * File:: fsck.c
+ *
+ * Description:: Offline consistency checker. The inode table is read
+ *            in large runs straight from disk, and chains and block
+ *            reference counts are read a cached block at a time, so
+ *            only bitsets of the blocks and inodes stay in memory.
+ *            The tree is walked with the fs_walk pool and every block
+ *            something holds is marked, so cross-linked chains, blocks
+ *            on both a chain and the free list, and blocks no one
+ *            holds show up without a second pass over the volume.
+ *            Every free path puts blocks back on the free chain, so a
+ *            block no one holds that is off it was lost.
+ *
+ *	Usage: fsck volume [-r]
+ *	Without -r the volume is opened read only. Its journal is not
+ *	replayed and nothing is written, so a volume with transactions
+ *	still in its journal is refused. With -r it is mounted as usual,
+ *	replaying the journal, and the problems found are repaired. The
+ *	exit status is 0 for a consistent volume and 1 if problems were
+ *	found or the volume could not be checked.
+ *
+ **************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include "fsLow.h"
+#include "mfs.h"
+#include "inode.h"
+#include "memo.h"
+#include "freeSpaceManagement.h"
+#include "dentryCache.h"
+#include "fsWalk.h"
+
+#define FSCK_READ_BLOCKS 256 // blocks read from disk with one call
+
+// an entry to take out of its directory when repairing
+typedef struct
+{
+  uint64_t parent;
+  uint32_t inode;
+  int freeInode; // no other entry holds the inode
+  char name[256];
+} BadEntry;
+
+// a growing list of block numbers
+typedef struct
+{
+  uint64_t *block;
+  uint64_t count;
+  uint64_t capacity;
+} BlockList;
+
+// live entries a directory says it holds against those the walk saw
+typedef struct
+{
+  unsigned int expected;
+  unsigned int seen;
+} DirCount;
+
+static unsigned char *used; // attributes of every inode, 0 if free
+
+static uint64_t *owned;   // blocks held by the volume's metadata or a file
+static uint64_t *onFree;  // blocks on the free chain
+static uint64_t *reached; // inodes some entry refers to
+
+static uint64_t firstData; // first block past the VCB and the map
+
+static BlockList extra;   // a block for every holder past its first
+static BlockList unended; // last blocks of chains that go on past them
+
+static BadEntry *bad;
+static int badCount;
+static int badCapacity;
+
+static int problems;       // inconsistencies found
+static int walkComplete;   // every entry of the tree was seen
+static int chainBroken;    // the free chain does not end where it should
+static int freeConflict;   // a held block is on the free chain
+static uint64_t lastFree;  // last block of the free chain before a break
+static uint64_t freeCount; // blocks on the free chain
+
+static void problem(const char *format, ...)
+{
+  va_list args;
+  va_start(args, format);
+  vprintf(format, args);
+  va_end(args);
+  printf("\n");
+  problems++;
+}
+
+static int testBit(const uint64_t *bits, uint64_t n)
+{
+  return (bits[n / 64] >> (n % 64)) & 1;
+}
+
+static void setBit(uint64_t *bits, uint64_t n)
+{
+  bits[n / 64] |= (uint64_t)1 << (n % 64);
+}
+
+static uint64_t *newBitset(uint64_t bits)
+{
+  return calloc((bits + 63) / 64, sizeof(uint64_t));
+}
+
+// reads blocks blocks from location into dest, FSCK_READ_BLOCKS at a time
+static int readRun(void *dest, uint64_t location, uint64_t blocks)
+{
+  char *to = dest;
+  for (uint64_t done = 0; done < blocks; done += FSCK_READ_BLOCKS)
+  {
+    uint64_t count = blocks - done < FSCK_READ_BLOCKS ? blocks - done : FSCK_READ_BLOCKS;
+    if (fs_LBAread(to + BLOCKS_TO_BYTES(done), count, location + done) != count)
+    {
+      perror("LBAread failed");
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static int push(BlockList *list, uint64_t block)
+{
+  if (list->count == list->capacity)
+  {
+    uint64_t capacity = list->capacity > 0 ? list->capacity * 2 : 1024;
+    uint64_t *grown = realloc(list->block, capacity * sizeof(uint64_t));
+    if (grown == NULL)
+    {
+      perror("fsck: malloc failed");
+      return -1;
+    }
+    list->block = grown;
+    list->capacity = capacity;
+  }
+  list->block[list->count++] = block;
+  return 0;
+}
+
+// Checks the first blocks blocks of the chain at location are all on
+// the volume, 0 if they are
+static int followChain(const char *what, uint64_t location, uint64_t blocks)
+{
+  uint64_t block = location;
+
+  for (uint64_t i = 0; i < blocks; i++)
+  {
+    if ((int64_t)block == END_OF_CHAIN)
+    {
+      problem("%s: chain ends after %lu of its %lu blocks", what, i, blocks);
+      return -1;
+    }
+    if (block < firstData || block >= (uint64_t)myVCB->blockTotal)
+    {
+      problem("%s: block %lu of the chain is %ld, outside the volume", what, i, (long)block);
+      return -1;
+    }
+    block = get_next_block(block);
+  }
+  return 0;
+}
+
+// Marks the blocks of a chain followChain accepted as held by what. A
+// block held twice is fine where sharable, the block references must
+// then count it.
+static void claimChain(const char *what, uint64_t location, uint64_t blocks, int sharable)
+{
+  uint64_t block = location;
+  uint64_t freed = 0;
+  uint64_t crossed = 0;
+
+  for (uint64_t i = 0; i < blocks; i++)
+  {
+    freed += testBit(onFree, block);
+    if (testBit(owned, block))
+    {
+      crossed++;
+      if (sharable)
+      {
+        push(&extra, block);
+      }
+    }
+    setBit(owned, block);
+
+    if (i == blocks - 1 && get_next_block(block) != END_OF_CHAIN)
+    {
+      problem("%s: chain goes on past its %lu blocks", what, blocks);
+      push(&unended, block);
+    }
+    block = get_next_block(block);
+  }
+
+  if (freed > 0)
+  {
+    problem("%s: %lu blocks are on the free chain", what, freed);
+    freeConflict = 1;
+  }
+  if (crossed > 0 && !sharable)
+  {
+    problem("%s: %lu blocks are cross-linked", what, crossed);
+  }
+}
+
+// checks a chain the volume itself holds
+static void checkChain(const char *what, uint64_t location, uint64_t blocks)
+{
+  if (followChain(what, location, blocks) == 0)
+  {
+    claimChain(what, location, blocks, 0);
+  }
+}
+
+static int addBad(const WalkItem *item, int freeInode)
+{
+  if (badCount == badCapacity)
+  {
+    int capacity = badCapacity > 0 ? badCapacity * 2 : 16;
+    BadEntry *grown = realloc(bad, capacity * sizeof(BadEntry));
+    if (grown == NULL)
+    {
+      perror("fsck: malloc failed");
+      return -1;
+    }
+    bad = grown;
+    badCapacity = capacity;
+  }
+  bad[badCount].parent = item->parent;
+  bad[badCount].inode = item->entry.inode;
+  bad[badCount].freeInode = freeInode;
+  strcpy(bad[badCount].name, item->entry.name);
+  badCount++;
+  return 0;
+}
+
+// checks the inode of an entry, 0 if it is fine
+static int checkInode(const WalkItem *item)
+{
+  uint32_t number = item->entry.inode;
+
+  if (number == INODE_NONE || number >= (uint32_t)myVCB->inodeCount)
+  {
+    problem("%s: inode %u is out of range", item->path, number);
+    return -1;
+  }
+  if (testBit(reached, number))
+  {
+    problem("%s: inode %u is used by another entry", item->path, number);
+    return -1;
+  }
+  setBit(reached, number);
+
+  if (used[number] == 0)
+  {
+    problem("%s: inode %u is free", item->path, number);
+    return -1;
+  }
+  if (used[number] != item->entry.attributes)
+  {
+    problem("%s: inode %u is a '%c', the entry says '%c'", item->path, number,
+            used[number], item->entry.attributes);
+    return -1;
+  }
+  return 0;
+}
+
+static int checkFile(WalkItem *item)
+{
+  DirectoryEntry *entry = &item->entry;
+
+  if (checkInode(item) != 0)
+  {
+    return addBad(item, 0);
+  }
+
+  if (entry->num_blocks == 0)
+  {
+    if (entry->size > INODE_INLINE_BYTES)
+    {
+      problem("%s: %lu bytes but no blocks", item->path, entry->size);
+      return addBad(item, 1);
+    }
+    return 0;
+  }
+
+  if (entry->size > BLOCKS_TO_BYTES((uint64_t)entry->num_blocks))
+  {
+    problem("%s: %lu bytes do not fit its %u blocks", item->path, entry->size,
+            entry->num_blocks);
+    return addBad(item, 1);
+  }
+
+  // a broken chain marks nothing, so blocks only it held are reclaimed
+  if (followChain(item->path, entry->location, entry->num_blocks) != 0)
+  {
+    return addBad(item, 1);
+  }
+  claimChain(item->path, entry->location, entry->num_blocks, 1);
+  return 0;
+}
+
+static int checkDirectory(WalkItem *item)
+{
+  DirHeader header;
+
+  if (load_dir_header(item->entry.location, &header) != 0 || header.magic != DIR_MAGIC)
+  {
+    problem("%s: directory header is damaged", item->path);
+    return -1;
+  }
+
+  // the root has no entry, and so no inode. A directory is only
+  // reported, taking it out would lose everything below it.
+  if (item->depth > 0)
+  {
+    checkInode(item);
+  }
+
+  // the header block, each segment and the name heap are chains of
+  // their own
+  unsigned int blocks = 1;
+  checkChain(item->path, header.location, 1);
+  for (unsigned int i = 0; i < header.segments && i < DIR_MAX_SEGMENTS; i++)
+  {
+    checkChain(item->path, header.segment[i].location, header.segment[i].num_blocks);
+    blocks += header.segment[i].num_blocks;
+  }
+  if (header.heap_blocks > 0)
+  {
+    checkChain(item->path, header.heap_location, header.heap_blocks);
+    blocks += header.heap_blocks;
+  }
+  if (blocks != header.num_blocks)
+  {
+    problem("%s: directory holds %u blocks, its header says %u", item->path, blocks,
+            header.num_blocks);
+  }
+
+  DirCount *count = calloc(1, sizeof(DirCount));
+  if (count == NULL)
+  {
+    perror("fsck: malloc failed");
+    return -1;
+  }
+  count->expected = header.count;
+  item->data = count;
+  return 0;
+}
+
+static int checkEntry(WalkItem *item, int event)
+{
+  DirCount *parent = item->parentData;
+  if (event != WALK_POST && parent != NULL)
+  {
+    parent->seen++;
+  }
+
+  if (event == WALK_FILE)
+  {
+    return checkFile(item);
+  }
+  if (event == WALK_PRE)
+  {
+    return checkDirectory(item);
+  }
+
+  // entries the walk could not read leave their blocks unmarked
+  DirCount *count = item->data;
+  if (count->seen != count->expected)
+  {
+    problem("%s: %u of %u entries could be read", item->path, count->seen, count->expected);
+    walkComplete = 0;
+  }
+  free(count);
+  return 0;
+}
+
+// the checks read the volume and share the bitsets and the counts, so
+// they run one at a time. The pool only spreads the scheduling, the
+// check itself is serial
+static int checkVisit(WalkItem *item, int event, void *arg)
+{
+  fs_walk_lock();
+  int result = checkEntry(item, event);
+  fs_walk_unlock();
+  return result;
+}
+
+// marks the blocks the volume itself holds
+static void checkReserved()
+{
+  for (uint64_t block = 0; block < firstData; block++)
+  {
+    setBit(owned, block);
+  }
+  checkChain("inode table", myVCB->inodeTableLocation, myVCB->inodeTableBlocks);
+  checkChain("block references", myVCB->blockRefLocation, myVCB->blockRefBlocks);
+  checkChain("journal", myVCB->journalLocation, myVCB->journalBlocks);
+  checkChain("mount summary", myVCB->summaryLocation, 1);
+}
+
+// follows the free chain, which must hold freeBlocks blocks no one else does
+static void checkFreeChain()
+{
+  uint64_t block = myVCB->freeSpaceStartBlock;
+  lastFree = END_OF_CHAIN;
+  freeCount = 0;
+
+  while ((int64_t)block != END_OF_CHAIN)
+  {
+    if (block < firstData || block >= (uint64_t)myVCB->blockTotal)
+    {
+      problem("free chain: leaves the volume after %lu blocks", freeCount);
+      chainBroken = 1;
+      break;
+    }
+    if (testBit(onFree, block))
+    {
+      problem("free chain: loops back to block %lu", block);
+      chainBroken = 1;
+      break;
+    }
+    if (testBit(owned, block))
+    {
+      problem("free chain: block %lu is held by the volume", block);
+      chainBroken = 1;
+      break;
+    }
+
+    setBit(onFree, block);
+    freeCount++;
+    lastFree = block;
+    block = get_next_block(block);
+  }
+
+  if (freeCount != (uint64_t)myVCB->freeBlocks)
+  {
+    problem("free chain: holds %lu blocks, the VCB says %lu", freeCount, myVCB->freeBlocks);
+  }
+}
+
+// reads the attributes of every inode, and counts those in use
+static int loadInodes(uint64_t *inUse)
+{
+  used = calloc(myVCB->inodeCount, 1);
+  uint64_t perRun = BLOCKS_TO_BYTES(FSCK_READ_BLOCKS) / sizeof(Inode);
+  Inode *run = malloc(perRun * sizeof(Inode));
+  if (used == NULL || run == NULL)
+  {
+    perror("fsck: malloc failed");
+    free(run);
+    return -1;
+  }
+
+  // the table is one run of blocks, as allocated when formatting
+  *inUse = 0;
+  for (uint64_t first = 0; first < (uint64_t)myVCB->inodeCount; first += perRun)
+  {
+    uint64_t count = myVCB->inodeCount - first < perRun ? myVCB->inodeCount - first : perRun;
+    uint64_t blocks = get_num_blocks(count * sizeof(Inode), myVCB->block_size);
+    if (readRun(run, myVCB->inodeTableLocation + BLOCK_INDEX(first * sizeof(Inode)),
+                blocks) != 0)
+    {
+      free(run);
+      return -1;
+    }
+    for (uint64_t i = 0; i < count; i++)
+    {
+      used[first + i] = run[i].attributes;
+      if (first + i != INODE_NONE && run[i].attributes != 0)
+      {
+        (*inUse)++;
+      }
+    }
+  }
+  free(run);
+  return 0;
+}
+
+static int compareBlocks(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+// Every block's count must be the holders it has past the first. The
+// counts are read a window at a time, 0 if they could all be read
+static int checkRefs(int repair)
+{
+  uint64_t perRun = BLOCKS_TO_BYTES(FSCK_READ_BLOCKS) / sizeof(BlockRef);
+  BlockRef *refs = malloc(perRun * sizeof(BlockRef));
+  if (refs == NULL)
+  {
+    perror("fsck: malloc failed");
+    return -1;
+  }
+
+  uint64_t wrong = 0;
+  uint64_t next = 0;
+  uint64_t first = 0;
+
+  qsort(extra.block, extra.count, sizeof(uint64_t), compareBlocks);
+  for (uint64_t block = 0; block < (uint64_t)myVCB->blockTotal; block++)
+  {
+    if (block == first + perRun || block == 0)
+    {
+      first = block;
+      uint64_t count = myVCB->blockTotal - first < perRun ? myVCB->blockTotal - first : perRun;
+      if (cacheReadBytes(refs, myVCB->blockRefLocation, first * sizeof(BlockRef),
+                         count * sizeof(BlockRef)) != 0)
+      {
+        free(refs);
+        return -1;
+      }
+    }
+
+    BlockRef holders = 0;
+    while (next < extra.count && extra.block[next] == block)
+    {
+      holders++;
+      next++;
+    }
+    if (refs[block - first] == holders)
+    {
+      continue;
+    }
+
+    if (wrong++ < 10)
+    {
+      printf("block %lu: %u other holders, counted %u\n", block, holders, refs[block - first]);
+    }
+    if (repair)
+    {
+      cacheWriteBytes(&holders, myVCB->blockRefLocation, block * sizeof(BlockRef),
+                      sizeof(BlockRef));
+    }
+  }
+  free(refs);
+  if (wrong > 0)
+  {
+    problem("block references: %lu blocks counted wrong", wrong);
+  }
+  return 0;
+}
+
+// puts every block no one holds and that is off the free chain back on it
+static uint64_t reclaim(int repair)
+{
+  uint64_t leaked = 0;
+  uint64_t block = firstData;
+
+  while (block < (uint64_t)myVCB->blockTotal)
+  {
+    if (testBit(owned, block) || testBit(onFree, block))
+    {
+      block++;
+      continue;
+    }
+
+    uint64_t start = block;
+    while (block < (uint64_t)myVCB->blockTotal && !testBit(owned, block) &&
+           !testBit(onFree, block))
+    {
+      block++;
+    }
+    leaked += block - start;
+    if (repair)
+    {
+      release_blocks(start, block - start);
+    }
+  }
+  return leaked;
+}
+
+// rebuilds the free chain from every block no one holds
+static void rebuildFree()
+{
+  memset(onFree, 0, ((myVCB->blockTotal + 63) / 64) * sizeof(uint64_t));
+  myVCB->freeBlocks = 0;
+  myVCB->freeSpaceStartBlock = END_OF_CHAIN;
+  reclaim(1);
+}
+
+static void repair(uint64_t inUse)
+{
+  // bad entries go first, their blocks stay marked until the next check
+  for (int i = 0; i < badCount; i++)
+  {
+    printf("removing %s\n", bad[i].name);
+    remove_de(bad[i].parent, bad[i].name);
+    dcacheRemove(bad[i].parent, bad[i].name);
+    if (bad[i].freeInode)
+    {
+      free_inode(bad[i].inode);
+      inUse--;
+    }
+  }
+
+  if (walkComplete)
+  {
+    for (uint32_t n = 1; n < (uint32_t)myVCB->inodeCount; n++)
+    {
+      if (used[n] != 0 && !testBit(reached, n))
+      {
+        free_inode(n);
+        inUse--;
+      }
+    }
+  }
+  myVCB->inodeFree = myVCB->inodeCount - 1 - inUse;
+
+  // a chain going on into blocks someone else holds is cut after its
+  // own, unless its last block is shared and the link is needed
+  for (uint64_t i = 0; i < unended.count; i++)
+  {
+    if (bsearch(&unended.block[i], extra.block, extra.count, sizeof(uint64_t),
+                compareBlocks) == NULL)
+    {
+      set_next_block(unended.block[i], END_OF_CHAIN);
+    }
+  }
+
+  if (chainBroken || freeConflict)
+  {
+    if (walkComplete)
+    {
+      printf("rebuilding the free chain\n");
+      rebuildFree();
+    }
+    else
+    {
+      // without the whole tree, only the chain's good start can be trusted
+      if ((int64_t)lastFree == END_OF_CHAIN)
+      {
+        myVCB->freeSpaceStartBlock = END_OF_CHAIN;
+      }
+      else
+      {
+        set_next_block(lastFree, END_OF_CHAIN);
+      }
+      myVCB->freeBlocks = freeCount;
+      rebuild_free();
+    }
+  }
+  else
+  {
+    myVCB->freeBlocks = freeCount;
+    rebuild_free();
+    if (walkComplete)
+    {
+      reclaim(1);
+    }
+  }
+  write_fs();
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc < 2)
+  {
+    printf("Usage: fsck volume [-r]\n");
+    return 1;
+  }
+  int repairing = argc > 2 && strcmp(argv[2], "-r") == 0;
+
+  uint64_t volumeSize = 0;
+  uint64_t blockSize = 0;
+  if (startPartitionSystem(argv[1], &volumeSize, &blockSize) != 0 || volumeSize == 0)
+  {
+    printf("Cannot open the volume %s\n", argv[1]);
+    return 1;
+  }
+  // only a repair mounts the volume, which replays the journal and writes
+  int mounted = repairing ? initFileSystem(volumeSize / blockSize, blockSize)
+                          : initFileSystemReadOnly(volumeSize / blockSize, blockSize);
+  if (mounted != 0)
+  {
+    printf("Cannot check %s%s\n", argv[1], repairing ? "" : ", -r mounts it and replays its journal");
+    closePartitionSystem();
+    return 1;
+  }
+
+  // the inode table is read straight from disk, so the cache must be home first
+  flushAllBuffers();
+
+  uint64_t blocks = myVCB->blockTotal;
+  firstData = 1 + myVCB->freespace_size;
+  owned = newBitset(blocks);
+  onFree = newBitset(blocks);
+  reached = newBitset(myVCB->inodeCount);
+  uint64_t inUse = 0;
+
+  if (owned == NULL || onFree == NULL || reached == NULL || loadInodes(&inUse) != 0)
+  {
+    printf("Cannot read the volume's metadata\n");
+    exitFileSystem();
+    closePartitionSystem();
+    return 1;
+  }
+
+  printf("checking %s: %lu blocks of %d bytes\n", argv[1], blocks, myVCB->block_size);
+
+  checkReserved();
+  checkFreeChain();
+
+  walkComplete = 1;
+  if (fs_walk("/", 0, checkVisit, NULL) != 0)
+  {
+    printf("the tree could not be walked to the end\n");
+    problems++;
+    walkComplete = 0;
+  }
+
+  uint64_t orphans = 0;
+  for (uint32_t n = 1; n < (uint32_t)myVCB->inodeCount; n++)
+  {
+    if (used[n] != 0 && !testBit(reached, n))
+    {
+      orphans++;
+    }
+  }
+  if (walkComplete && orphans > 0)
+  {
+    problem("inodes: %lu in use but not reached from the root", orphans);
+  }
+  if ((uint64_t)myVCB->inodeFree != myVCB->inodeCount - 1 - inUse)
+  {
+    problem("inodes: %lu in use, the VCB says %d are free", inUse, myVCB->inodeFree);
+  }
+
+  if (checkRefs(repairing && walkComplete) != 0)
+  {
+    printf("the block references could not be read\n");
+    problems++;
+  }
+
+  // blocks lost to the volume, -r puts them back on the free chain
+  uint64_t leaked = walkComplete ? reclaim(0) : 0;
+  if (leaked > 0)
+  {
+    problem("free space: %lu blocks no one holds are off the free chain", leaked);
+  }
+
+  printf("%lu files and directories, %lu free blocks\n", inUse, freeCount);
+
+  if (repairing && problems > 0)
+  {
+    repair(inUse);
+    printf("repaired, %lu free blocks\n", myVCB->freeBlocks);
+  }
+  printf("%d problems found\n", problems);
+
+  exitFileSystem();
+  closePartitionSystem();
+  return problems > 0;
+}
@@ -34,6 +34,7 @@
 #define DOUBLE_QUOTE	0x22
 #define BUFFERLEN			200
 #define DIRMAX_LEN		4096
+#define LS_BATCH		64	//directory entries read per fs_readdir_batch call
 
 /****   SET THESE TO 1 WHEN READY TO TEST THAT COMMAND ****/
 #define CMDLS_ON	1
@@ -47,6 +48,9 @@
 #define CMDPWD_ON	1
 #define CMDTOUCH_ON	1
 #define CMDCAT_ON	1
+#define CMDSTATS_ON	1
+#define CMDDU_ON	1
+#define CMDSNAP_ON	1
 
 
 typedef struct dispatch_t
@@ -68,54 +72,68 @@ int cmd_cp2l (int argcnt, char *argvec[]);
 int cmd_cp2fs (int argcnt, char *argvec[]);
 int cmd_cd (int argcnt, char *argvec[]);
 int cmd_pwd (int argcnt, char *argvec[]);
+int cmd_stats (int argcnt, char *argvec[]);
+int cmd_du (int argcnt, char *argvec[]);
+int cmd_snap (int argcnt, char *argvec[]);
 int cmd_history (int argcnt, char *argvec[]);
 int cmd_help (int argcnt, char *argvec[]);
 
 dispatch_t dispatchTable[] = {
 	{"ls", cmd_ls, "Lists the file in a directory"},
-	{"cp", cmd_cp, "Copies a file - source [dest]"},
+	{"cp", cmd_cp, "Copies a file sharing its blocks - [-r] source [dest], -r copies a whole tree"},
 	{"mv", cmd_mv, "Moves a file - source dest"},
 	{"md", cmd_md, "Make a new directory"},
-	{"rm", cmd_rm, "Removes a file or directory"},
+	{"rm", cmd_rm, "Removes a file or directory - [-r] removes a whole tree"},
         {"touch",cmd_touch, "Touches/Creates a file"},
         {"cat", cmd_cat, "Limited version of cat that displace the file to the console"},
 	{"cp2l", cmd_cp2l, "Copies a file from the test file system to the linux file system"},
 	{"cp2fs", cmd_cp2fs, "Copies a file from the Linux file system to the test file system"},
 	{"cd", cmd_cd, "Changes directory"},
 	{"pwd", cmd_pwd, "Prints the working directory"},
+	{"stats", cmd_stats, "Prints cache and I/O counters - [-r] resets them"},
+	{"du", cmd_du, "Prints the space used below each directory - [-s] [path]"},
+	{"snap", cmd_snap, "Takes a snapshot of a tree sharing its blocks - source dest"},
 	{"history", cmd_history, "Prints out the history"},
 	{"help", cmd_help, "Prints out help"}
 };
 
 static int dispatchcount = sizeof (dispatchTable) / sizeof (dispatch_t);
 
-// Display files for use by ls command
-int displayFiles (fdDir * dirp, int flall, int fllong)
+// Display files for use by ls command, in name order. With a pattern
+// only the matching names are shown
+int displayFiles (fdDir * dirp, int flall, int fllong, const char * pattern)
 	{
 #if (CMDLS_ON == 1)				
 	if (dirp == NULL)	//get out if error
 		return (-1);
 	
+	struct fs_diriteminfo entries[LS_BATCH];
+	struct fs_stat stats[LS_BATCH];
 	struct fs_diriteminfo * di;
-	struct fs_stat statbuf;
+	int count;
 	
-	di = fs_readdir (dirp);
 	printf("\n");
-	while (di != NULL) 
+	//read the directory a batch of entries at a time, with stat data for -l
+	while ((count = (pattern == NULL)
+			? fs_readdirplus_sorted (dirp, entries, fllong ? stats : NULL, LS_BATCH)
+			: fs_readdir_glob (dirp, pattern, entries, fllong ? stats : NULL, LS_BATCH)) > 0)
 		{
-		if ((di->d_name[0] != '.') || (flall)) //if not all and starts with '.' it is hidden
+		for (int i = 0; i < count; i++)
 			{
-			if (fllong)
+			di = &entries[i];
+			//if not all and starts with '.' it is hidden, unless the pattern asked for it
+			if ((di->d_name[0] != '.') || (flall) || (pattern != NULL))
 				{
-				fs_stat (di->d_name, &statbuf);
-				printf ("%s    %9ld   %s\n", fs_isDir(di->d_name)?"D":"-", statbuf.st_size, di->d_name);
-				}
-			else
-				{
-				printf ("%s\n", di->d_name);
+				if (fllong)
+					{
+					printf ("%s    %9ld   %s\n", di->fileType == 'd'?"D":"-", stats[i].st_size, di->d_name);
+					}
+				else
+					{
+					printf ("%s\n", di->d_name);
+					}
 				}
 			}
-		di = fs_readdir (dirp);
 		}
 	fs_closedir (dirp);
 #endif
@@ -199,11 +217,35 @@ int cmd_ls (int argcnt, char *argvec[])
 		//processing arguments after options
 		for (int k = optind; k < argcnt; k++)
 			{
-			if (fs_isDir(argvec[k]))
+			if (strpbrk (argvec[k], "*?[") != NULL)
+				{
+				//a pattern in the last component lists the matching names
+				char dirname[DIRMAX_LEN];
+				char * pattern = strrchr (argvec[k], '/');
+				if (pattern == NULL)
+					{
+					strcpy (dirname, ".");
+					pattern = argvec[k];
+					}
+				else
+					{
+					int len = (pattern == argvec[k]) ? 1 : pattern - argvec[k];
+					if (len >= DIRMAX_LEN)
+						len = DIRMAX_LEN - 1;
+					strncpy (dirname, argvec[k], len);
+					dirname[len] = '\0';
+					pattern++;
+					}
+				fdDir * dirp;
+				dirp = fs_opendir (dirname);
+				if (displayFiles (dirp, flall, fllong, pattern) != 0)
+					printf ("%s is not found\n", dirname);
+				}
+			else if (fs_isDir(argvec[k]))
 				{
 				fdDir * dirp;
 				dirp = fs_opendir (argvec[k]);
-				displayFiles (dirp, flall, fllong);
+				displayFiles (dirp, flall, fllong, NULL);
 				}
 			else // it is just a file ?
 				{
@@ -224,7 +266,7 @@ int cmd_ls (int argcnt, char *argvec[])
 		char * path = fs_getcwd(cwd, DIRMAX_LEN);	//get current working directory
 		fdDir * dirp;
 		dirp = fs_opendir (path);
-		return (displayFiles (dirp, flall, fllong));
+		return (displayFiles (dirp, flall, fllong, NULL));
 		}
 #endif
 	return 0;
@@ -318,12 +360,17 @@ int cmd_cat (int argcnt, char *argvec[])
 int cmd_cp (int argcnt, char *argvec[])
 	{
 #if (CMDCP_ON == 1)	
-	int testfs_src_fd;
-	int testfs_dest_fd;
 	char * src;
 	char * dest;
-	int readcnt;
-	char buf[BUFFERLEN];
+	int recursive = 0;
+	
+	//-r copies the whole tree below src
+	if ((argcnt > 1) && (strcmp(argvec[1], "-r") == 0))
+		{
+		recursive = 1;
+		argcnt--;
+		argvec++;
+		}
 	
 	switch (argcnt)
 		{
@@ -338,20 +385,19 @@ int cmd_cp (int argcnt, char *argvec[])
 			break;
 		
 		default:
-			printf("Usage: cp srcfile [destfile]\n");
+			printf("Usage: cp [-r] srcfile [destfile]\n");
 			return (-1);
 		}
 	
-	
-	testfs_src_fd = b_open (src, O_RDONLY);
-	testfs_dest_fd = b_open (dest, O_WRONLY | O_CREAT | O_TRUNC);
-	do 
+	if (recursive)
 		{
-		readcnt = b_read (testfs_src_fd, buf, BUFFERLEN);
-		b_write (testfs_dest_fd, buf, readcnt);
-		} while (readcnt == BUFFERLEN);
-	b_close (testfs_src_fd);
-	b_close (testfs_dest_fd);
+		return (fs_copy_tree (src, dest, 0));
+		}
+	
+	
+	//the copy shares the blocks of src, b_clone replaces an existing dest
+	//only once the copy is made
+	return (b_clone (dest, src));
 #endif
 	return 0;
 	}
@@ -408,9 +454,14 @@ int cmd_md (int argcnt, char *argvec[])
 int cmd_rm (int argcnt, char *argvec[])
 	{
 #if (CMDRM_ON == 1)
+	//-r removes the whole tree below path
+	if ((argcnt == 3) && (strcmp(argvec[1], "-r") == 0))
+		{
+		return (fs_remove_tree (argvec[2], 0));
+		}
 	if (argcnt != 2)
 		{
-		printf ("Usage: rm path\n");
+		printf ("Usage: rm [-r] path\n");
 		return -1;
 		}
 		
@@ -462,7 +513,7 @@ int cmd_cp2l (int argcnt, char *argvec[])
 		}
 	
 	
-	testfs_fd = b_open (src, O_RDONLY);
+	testfs_fd = b_open (src, O_RDONLY | O_LARGEBUF);
 	linux_fd = open (dest, O_WRONLY | O_CREAT | O_TRUNC, PERMISSIONS);
 	do 
 		{
@@ -506,7 +557,7 @@ int cmd_cp2fs (int argcnt, char *argvec[])
 		}
 	
 	
-	testfs_fd = b_open (dest, O_WRONLY | O_CREAT | O_TRUNC);
+	testfs_fd = b_open (dest, O_WRONLY | O_CREAT | O_TRUNC | O_LARGEBUF);
 	linux_fd = open (src, O_RDONLY);
 	do 
 		{
@@ -576,6 +627,203 @@ int cmd_pwd (int argcnt, char *argvec[])
 	return 0;
 	}
 
+/****************************************************
+*  Stats commmand
+****************************************************/
+int cmd_stats (int argcnt, char *argvec[])
+	{
+#if (CMDSTATS_ON == 1)
+	struct fs_stats st;
+	uint64_t lookups;
+	
+	if ((argcnt == 2) && ((strcmp(argvec[1], "-r") == 0) ||
+		(strcmp(argvec[1], "--reset") == 0)))
+		{
+		fs_reset_stats();
+		printf ("Counters reset\n");
+		return 0;
+		}
+	if (argcnt != 1)
+		{
+		printf ("Usage: stats [--reset/-r]\n");
+		return (-1);
+		}
+		
+	fs_get_stats (&st);
+	lookups = st.cache_hits + st.cache_misses;
+	
+	printf ("Block layer\n");
+	printf ("  LBAread  calls %10llu  blocks %10llu  bytes %12llu\n",
+		(ull_t)st.lba_reads, (ull_t)st.blocks_read, (ull_t)st.bytes_read);
+	printf ("  LBAwrite calls %10llu  blocks %10llu  bytes %12llu\n",
+		(ull_t)st.lba_writes, (ull_t)st.blocks_written, (ull_t)st.bytes_written);
+	printf ("Buffer cache\n");
+	printf ("  hits %llu  misses %llu  hit rate %.1f%%\n",
+		(ull_t)st.cache_hits, (ull_t)st.cache_misses,
+		lookups ? (100.0 * st.cache_hits) / lookups : 0.0);
+	printf ("  evictions %llu  writebacks %llu  dirty now %llu\n",
+		(ull_t)st.cache_evictions, (ull_t)st.cache_writebacks,
+		(ull_t)st.cache_dirty);
+	printf ("File I/O\n");
+	printf ("  opens %llu  closes %llu\n",
+		(ull_t)st.file_opens, (ull_t)st.file_closes);
+	printf ("  reads %llu (%llu bytes)  writes %llu (%llu bytes)\n",
+		(ull_t)st.file_reads, (ull_t)st.file_bytes_read,
+		(ull_t)st.file_writes, (ull_t)st.file_bytes_written);
+	printf ("  inline files moved to blocks %llu\n", (ull_t)st.file_promotions);
+	printf ("  clones %llu (%llu blocks shared)  shared blocks copied %llu\n",
+		(ull_t)st.file_clones, (ull_t)st.blocks_shared,
+		(ull_t)st.cow_copies);
+	printf ("  blocks freed %llu\n", (ull_t)st.blocks_freed);
+	printf ("  buffer fills %llu  buffer drains %llu  syncs %llu\n",
+		(ull_t)st.file_buffer_fills, (ull_t)st.file_buffer_drains,
+		(ull_t)st.file_syncs);
+	printf ("Directories\n");
+	printf ("  path lookups %llu  dir reads %llu  dir writes %llu  "
+		"entry compares %llu\n",
+		(ull_t)st.path_lookups, (ull_t)st.dir_reads,
+		(ull_t)st.dir_writes, (ull_t)st.de_compares);
+	printf ("  dentry cache hits %llu (%llu negative)  misses %llu  "
+		"resets %llu\n",
+		(ull_t)st.dcache_hits, (ull_t)st.dcache_negatives,
+		(ull_t)st.dcache_misses, (ull_t)st.dcache_resets);
+	printf ("  filter rejects %llu  filters built %llu  indexes built %llu\n",
+		(ull_t)st.bloom_rejects, (ull_t)st.bloom_builds,
+		(ull_t)st.index_builds);
+	printf ("  inode reads %llu  inode writes %llu\n",
+		(ull_t)st.inode_reads, (ull_t)st.inode_writes);
+	printf ("Journal\n");
+	printf ("  commits %llu (%llu blocks, %llu records)  checkpoints %llu  "
+		"replayed %llu\n",
+		(ull_t)st.journal_commits, (ull_t)st.journal_blocks,
+		(ull_t)st.journal_records, (ull_t)st.journal_checkpoints,
+		(ull_t)st.journal_replays);
+#endif
+	return 0;
+	}
+
+/****************************************************
+*  Snapshot commmand
+****************************************************/
+int cmd_snap (int argcnt, char *argvec[])
+	{
+#if (CMDSNAP_ON == 1)
+	if (argcnt != 3)
+		{
+		printf ("Usage: snap source dest\n");
+		return (-1);
+		}
+	return (fs_snapshot_tree (argvec[1], argvec[2], 0));
+#endif
+	return 0;
+	}
+
+/****************************************************
+*  Disk usage commmand
+****************************************************/
+typedef struct du_dir_t
+	{
+	struct du_dir_t * parent;	//directory holding this one
+	uint64_t blocks;		//blocks used here and below
+	} du_dir_t;
+
+typedef struct du_walk_t
+	{
+	int summary;			//only print the total
+	uint64_t blksize;
+	} du_walk_t;
+
+//visitor for fs_walk, directories add up what is below them. A directory
+//gets blocks from its files and subdirectories on several workers, so
+//the sums are added under the walk's lock. The walk reads the
+//directories one at a time under the same lock
+static int du_visit (WalkItem * item, int event, void * arg)
+	{
+	du_walk_t * walk = arg;
+	du_dir_t * parent = item->parentData;
+	du_dir_t * dir;
+	
+	switch (event)
+		{
+		case WALK_FILE:
+			if (parent != NULL)
+				{
+				fs_walk_lock ();
+				parent->blocks += item->entry.num_blocks;
+				fs_walk_unlock ();
+				break;
+				}
+			//a file on its own is the whole walk
+			printf ("%-10llu %s\n",
+				(ull_t)(item->entry.num_blocks * walk->blksize + 1023) / 1024,
+				item->path);
+			break;
+			
+		case WALK_PRE:
+			dir = malloc (sizeof(du_dir_t));
+			if (dir == NULL)
+				return (-1);
+			dir->parent = parent;
+			dir->blocks = item->entry.num_blocks;
+			item->data = dir;
+			break;
+			
+		case WALK_POST:
+			dir = item->data;
+			if ((!walk->summary) || (dir->parent == NULL))
+				{
+				printf ("%-10llu %s\n",
+					(ull_t)(dir->blocks * walk->blksize + 1023) / 1024,
+					item->path);
+				}
+			if (dir->parent != NULL)
+				{
+				fs_walk_lock ();
+				dir->parent->blocks += dir->blocks;
+				fs_walk_unlock ();
+				}
+			free (dir);
+			break;
+		}
+	return 0;
+	}
+
+int cmd_du (int argcnt, char *argvec[])
+	{
+#if (CMDDU_ON == 1)
+	du_walk_t walk;
+	struct fs_stat st;
+	char * path = ".";
+	
+	walk.summary = 0;
+	
+	if ((argcnt > 1) && (strcmp(argvec[1], "-s") == 0))
+		{
+		walk.summary = 1;
+		argcnt--;
+		argvec++;
+		}
+	if (argcnt == 2)
+		{
+		path = argvec[1];
+		}
+	else if (argcnt != 1)
+		{
+		printf ("Usage: du [-s] [path]\n");
+		return (-1);
+		}
+		
+	if (fs_stat (path, &st) < 0)
+		{
+		return (-1);
+		}
+	walk.blksize = st.st_blksize;
+	
+	return (fs_walk (path, 0, du_visit, &walk));
+#endif
+	return 0;
+	}
+
 /****************************************************
 *  History commmand
 ****************************************************/
@@ -821,6 +1069,16 @@ int main (int argc, char * argv[])
         printf ("| cp2l                 |    ON    |\n");  
 #else
         printf ("| cp2l                 |    OFF   |\n");
+#endif
+#if (CMDSTATS_ON == 1)
+        printf ("| stats                |    ON    |\n");  
+#else
+        printf ("| stats                |    OFF   |\n");
+#endif
+#if (CMDSNAP_ON == 1)
+        printf ("| snap                 |    ON    |\n");  
+#else
+        printf ("| snap                 |    OFF   |\n");
 #endif
         printf ("|---------------------------------|\n");
 
@@ -0,0 +1,209 @@
+/**************************************************************
+ * Class::  CSC-415-02 Spring 2024
+ * Name:: Thiha Aung, Min Ye Thway Khaing, Dylan Nguyen
+ * GitHub-Name:: thihaaung32
+ * Group-Name:: Bee
+ * Project:: Basic File System
+ *
+ * File:: inode.c
+ *
+ * Description:: Inode table. Inodes are read and written through the
+ *            buffer cache one at a time, so a metadata update dirties
+ *            the one block holding the inode.
+ *
+ **************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include "inode.h"
+#include "freeSpaceManagement.h"
+#include "memo.h"
+#include "fsStats.h"
+
+// the table starts on a block and inodes divide it evenly, so the
+// metadata of an inode is always one line of the buffer cache
+typedef char inode_metadata_is_one_line[offsetof(Inode, data) == CACHE_LINE_BYTES ? 1 : -1];
+typedef char inode_is_whole_lines[sizeof(Inode) % CACHE_LINE_BYTES == 0 ? 1 : -1];
+
+// block of the table holding an inode
+static uint64_t inode_block(uint32_t number)
+{
+  return myVCB->inodeTableLocation + BLOCK_INDEX((uint64_t)number * sizeof(Inode));
+}
+
+// byte offset of an inode within its block
+static uint64_t inode_offset(uint32_t number)
+{
+  return BLOCK_OFFSET((uint64_t)number * sizeof(Inode));
+}
+
+static int valid_inode(uint32_t number)
+{
+  return number != INODE_NONE && number < (uint32_t)myVCB->inodeCount;
+}
+
+int initInodeTable()
+{
+  uint64_t count = (uint64_t)myVCB->blockTotal * myVCB->block_size / INODE_BYTES_PER;
+  if (count < INODE_MIN_COUNT)
+  {
+    count = INODE_MIN_COUNT;
+  }
+  if (count > INODE_MAX_COUNT)
+  {
+    count = INODE_MAX_COUNT;
+  }
+
+  int blocks = get_num_blocks(count * sizeof(Inode), myVCB->block_size);
+  int64_t location = allocateBlock(blocks);
+
+  // a zeroed inode is free
+  if (location == -1 || clear_blocks(location, blocks) != 0)
+  {
+    perror("Failed to write the inode table");
+    return -1;
+  }
+
+  // the slack of the last block holds inodes too, inode 0 is never used
+  myVCB->inodeTableLocation = location;
+  myVCB->inodeTableBlocks = blocks;
+  myVCB->inodeCount = BLOCKS_TO_BYTES(blocks) / sizeof(Inode);
+  myVCB->inodeFree = myVCB->inodeCount - 1;
+  myVCB->inodeNext = 1;
+  return 0;
+}
+
+int alloc_inode(DirectoryEntry *entry)
+{
+  if (myVCB->inodeFree == 0)
+  {
+    printf("No free inodes left\n");
+    return -1;
+  }
+
+  // look for a free inode from where the last search stopped
+  uint32_t number = myVCB->inodeNext;
+  for (int tried = 0; tried < myVCB->inodeCount; tried++, number++)
+  {
+    if (!valid_inode(number))
+    {
+      number = 1;
+    }
+
+    unsigned char attributes;
+    STAT_INC(inode_reads);
+    if (cacheReadBytes(&attributes, inode_block(number),
+                       inode_offset(number) + offsetof(Inode, attributes), 1) != 0)
+    {
+      return -1;
+    }
+
+    if (attributes == 0)
+    {
+      entry->inode = number;
+      myVCB->inodeNext = number + 1;
+      myVCB->inodeFree--;
+      return write_inode(entry);
+    }
+  }
+
+  printf("No free inodes left\n");
+  return -1;
+}
+
+int read_inode(uint32_t number, DirectoryEntry *entry)
+{
+  if (!valid_inode(number))
+  {
+    printf("Inode %u is out of range\n", number);
+    return -1;
+  }
+
+  // the inline data is read only by those who ask for it
+  Inode inode;
+  STAT_INC(inode_reads);
+  if (cacheReadBytes(&inode, inode_block(number), inode_offset(number),
+                     offsetof(Inode, data)) != 0)
+  {
+    return -1;
+  }
+
+  entry->inode = number;
+  entry->location = inode.location;
+  entry->size = inode.size;
+  entry->timeCreated = inode.timeCreated;
+  entry->timeLastModified = inode.timeLastModified;
+  entry->timeLastViewed = inode.timeLastViewed;
+  entry->num_blocks = inode.num_blocks;
+  entry->attributes = inode.attributes;
+  return 0;
+}
+
+int write_inode(const DirectoryEntry *entry)
+{
+  if (!valid_inode(entry->inode))
+  {
+    printf("Inode %u is out of range\n", entry->inode);
+    return -1;
+  }
+
+  Inode inode;
+  memset(&inode, 0, sizeof(Inode));
+  inode.location = entry->location;
+  inode.size = entry->size;
+  inode.timeCreated = entry->timeCreated;
+  inode.timeLastModified = entry->timeLastModified;
+  inode.timeLastViewed = entry->timeLastViewed;
+  inode.num_blocks = entry->num_blocks;
+  inode.attributes = entry->attributes;
+
+  STAT_INC(inode_writes);
+  return cacheWriteBytes(&inode, inode_block(entry->inode), inode_offset(entry->inode),
+                         offsetof(Inode, data));
+}
+
+int read_inline_data(uint32_t number, void *data, uint64_t length)
+{
+  if (!valid_inode(number) || length > INODE_INLINE_BYTES)
+  {
+    return -1;
+  }
+
+  STAT_INC(inode_reads);
+  return cacheReadBytes(data, inode_block(number),
+                        inode_offset(number) + offsetof(Inode, data), length);
+}
+
+int write_inline_data(uint32_t number, const void *data, uint64_t length)
+{
+  if (!valid_inode(number) || length > INODE_INLINE_BYTES)
+  {
+    return -1;
+  }
+
+  STAT_INC(inode_writes);
+  return cacheWriteBytes(data, inode_block(number),
+                         inode_offset(number) + offsetof(Inode, data), length);
+}
+
+int free_inode(uint32_t number)
+{
+  if (!valid_inode(number))
+  {
+    printf("Inode %u is out of range\n", number);
+    return -1;
+  }
+
+  Inode inode;
+  memset(&inode, 0, sizeof(Inode));
+
+  STAT_INC(inode_writes);
+  if (cacheWriteBytes(&inode, inode_block(number), inode_offset(number), sizeof(Inode)) != 0)
+  {
+    return -1;
+  }
+  myVCB->inodeFree++;
+  return 0;
+}
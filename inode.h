@@ -0,0 +1,74 @@
+/**************************************************************
+ * Class::  CSC-415-02 Spring 2024
+ * Name:: Thiha Aung, Min Ye Thway Khaing, Dylan Nguyen
+ * GitHub-Name:: thihaaung32
+ * Group-Name:: Bee
+ * Project:: Basic File System
+ *
+ * File:: inode.h
+ *
+ * Description:: Interface of the inode table. The metadata of every
+ *            file and directory (location, size, blocks and times)
+ *            lives in a fixed-size inode, and directory records
+ *            point to it by number. Changing a file's metadata
+ *            rewrites its inode only, and a rename or move carries
+ *            the number without copying the metadata.
+ *
+ *	The table is allocated when the volume is formatted, one
+ *	contiguous run of blocks sized by INODE_BYTES_PER. Inodes never
+ *	cross a block boundary. The metadata fills the first cache line
+ *	of an inode, so a metadata update touches one line.
+ *
+ *	A file of up to INODE_INLINE_BYTES is kept in the rest of its
+ *	inode and has no blocks (num_blocks is 0). It moves to blocks
+ *	the first time a write would take it past that size.
+ *
+ **************************************************************/
+
+#ifndef _INODE_H
+#define _INODE_H
+
+#include "structure.h"
+
+#define INODE_NONE 0                // number of no inode, "." and ".." have none
+#define INODE_BYTES_PER (16 * 1024) // volume bytes per inode when formatting
+#define INODE_MIN_COUNT 64          // fewest inodes a volume gets
+#define INODE_MAX_COUNT (1 << 30)   // most inodes a volume gets, numbers are 32 bits
+#define INODE_INLINE_BYTES 192      // largest file kept inside its inode
+
+// This is the on-disk form of an inode, 256 bytes
+typedef struct
+{
+  uint64_t location;        // block location of the data
+  uint64_t size;            // size of the file in bytes
+  time_t timeCreated;       // time file was created
+  time_t timeLastModified;  // time file was last modified
+  time_t timeLastViewed;    // time file was last accessed
+  uint32_t num_blocks;      // number of blocks
+  unsigned char attributes; // attributes of the file, 0 while the inode is free
+  unsigned char reserved[19];
+  char data[INODE_INLINE_BYTES]; // contents of an inline file
+} Inode;
+
+// allocates and clears the table of a new volume, 0 on success
+int initInodeTable();
+
+// gives entry a new inode holding its metadata and sets entry->inode,
+// 0 on success or -1 if the table is full
+int alloc_inode(DirectoryEntry *entry);
+
+// fills in the metadata of entry from inode number, the name is left alone
+int read_inode(uint32_t number, DirectoryEntry *entry);
+
+// writes the metadata of entry to its inode
+int write_inode(const DirectoryEntry *entry);
+
+// read and write the contents of an inline file, length is at most
+// INODE_INLINE_BYTES
+int read_inline_data(uint32_t number, void *data, uint64_t length);
+int write_inline_data(uint32_t number, const void *data, uint64_t length);
+
+// returns an inode to the table, call when its last name is removed
+int free_inode(uint32_t number);
+
+#endif
@@ -0,0 +1,571 @@
+/**************************************************************
+ * Class::  CSC-415-02 Spring 2024
+ * Name:: Thiha Aung, Min Ye Thway Khaing, Dylan Nguyen
+ * GitHub-Name:: thihaaung32
+ * Group-Name:: Bee
+ * Project:: Basic File System
+ *
+ * File:: journal.c
+ *
+ * Description:: Metadata journal. Records collect in one in-memory
+ *            transaction until a group of operations is complete or
+ *            the transaction is full, then it is written to the ring
+ *            with one LBAwrite. The VCB is not in the buffer cache,
+ *            its changes are found by comparing it with a copy taken
+ *            at the last commit.
+ *
+ **************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "journal.h"
+#include "freeSpaceManagement.h"
+#include "memo.h"
+#include "fsStats.h"
+
+#define FNV_OFFSET 14695981039346656037ull
+#define FNV_PRIME 1099511628211ull
+
+static JournalSuper journalSuper; // superblock as last written
+static char *txBuffer = NULL;     // transaction being built, header first
+static uint64_t txBytes = 0;      // bytes of records in txBuffer
+static uint64_t txLimit = 0;      // most bytes of records a transaction takes
+static uint32_t txLimitBlocks = 0; // ring blocks of the largest transaction
+static int txOps = 0;             // operations finished since the last commit
+static int txCommitting = 0;      // the VCB and map changes are being logged
+static uint64_t nextSequence = 0; // sequence number of the next transaction
+static uint32_t ringHead = 0;     // ring block the next transaction goes to
+static uint32_t ringUsed = 0;     // ring blocks written since the last checkpoint
+static int journalRunning = 0;    // records are being taken
+static char *shadowVCB = NULL;    // VCB block as last logged
+static char *sparseData = NULL;   // scratch for JOURNAL_SPARSE records
+
+static uint32_t ringBlocks()
+{
+  return myVCB->journalBlocks - 1;
+}
+
+static uint64_t ringLba(uint32_t block)
+{
+  return myVCB->journalLocation + 1 + block;
+}
+
+static uint64_t checksum(uint64_t hash, const void *data, uint64_t length)
+{
+  const unsigned char *p = data;
+  for (uint64_t i = 0; i < length; i++)
+  {
+    hash = (hash ^ p[i]) * FNV_PRIME;
+  }
+  return hash;
+}
+
+static int writeSuper()
+{
+  char *block = calloc(1, myVCB->block_size);
+  if (block == NULL)
+  {
+    return -1;
+  }
+  memcpy(block, &journalSuper, sizeof(JournalSuper));
+
+  int result = fs_LBAwrite(block, 1, myVCB->journalLocation) == 1 ? 0 : -1;
+  free(block);
+  if (result != 0)
+  {
+    perror("LBAwrite failed when writing the journal superblock\n");
+  }
+  return result;
+}
+
+int initJournal()
+{
+  uint64_t bytes = (uint64_t)myVCB->blockTotal * myVCB->block_size / JOURNAL_VOLUME_SHARE;
+  if (bytes < JOURNAL_MIN_BYTES)
+  {
+    bytes = JOURNAL_MIN_BYTES;
+  }
+  if (bytes > JOURNAL_MAX_BYTES)
+  {
+    bytes = JOURNAL_MAX_BYTES;
+  }
+
+  int blocks = get_num_blocks(bytes, myVCB->block_size);
+  if (blocks < JOURNAL_MIN_BLOCKS)
+  {
+    blocks = JOURNAL_MIN_BLOCKS;
+  }
+
+  int64_t location = allocateBlock(blocks);
+  if (location == -1)
+  {
+    return -1;
+  }
+  myVCB->journalLocation = location;
+  myVCB->journalBlocks = blocks;
+
+  // sequence numbers start from the clock, so transactions left on the
+  // disk by an earlier format never look like the next one
+  journalSuper.magic = JOURNAL_MAGIC;
+  journalSuper.version = JOURNAL_VERSION;
+  journalSuper.tail = 0;
+  journalSuper.reserved = 0;
+  journalSuper.sequence = (uint64_t)time(NULL) << 20;
+
+  ringHead = 0;
+  ringUsed = 0;
+  nextSequence = journalSuper.sequence;
+  return writeSuper();
+}
+
+// Reads the transaction at ring block pos into tx and returns the
+// blocks it occupies, 0 if there is no complete transaction with
+// sequence number seq there
+static uint32_t readTx(uint32_t pos, uint64_t seq, char *tx)
+{
+  uint32_t ring = ringBlocks();
+  if (fs_LBAread(tx, 1, ringLba(pos)) != 1)
+  {
+    return 0;
+  }
+
+  JournalTx header;
+  memcpy(&header, tx, sizeof(JournalTx));
+  if (header.magic != JOURNAL_TX_MAGIC || header.sequence != seq || header.blocks == 0 ||
+      header.blocks > ring - pos ||
+      sizeof(JournalTx) + header.bytes > BLOCKS_TO_BYTES(header.blocks))
+  {
+    return 0;
+  }
+
+  if (header.blocks > 1 &&
+      fs_LBAread(tx + myVCB->block_size, header.blocks - 1, ringLba(pos + 1)) != header.blocks - 1)
+  {
+    return 0;
+  }
+
+  uint64_t expected = header.checksum;
+  header.checksum = 0;
+  memcpy(tx, &header, sizeof(JournalTx));
+  if (checksum(FNV_OFFSET, tx, sizeof(JournalTx) + header.bytes) != expected)
+  {
+    return 0;
+  }
+  return header.blocks;
+}
+
+// Applies the records of a transaction to the cached home blocks
+static void applyTx(const char *tx, char *block)
+{
+  JournalTx header;
+  memcpy(&header, tx, sizeof(JournalTx));
+
+  const char *p = tx + sizeof(JournalTx);
+  const char *end = p + header.bytes;
+  while (p + sizeof(JournalRecord) <= end)
+  {
+    JournalRecord rec;
+    memcpy(&rec, p, sizeof(JournalRecord));
+    p += sizeof(JournalRecord);
+    if (p + rec.length > end)
+    {
+      break;
+    }
+
+    if (rec.type == JOURNAL_BYTES)
+    {
+      cacheWriteBytes(p, rec.lba, rec.offset, rec.length);
+    }
+    else if (rec.type == JOURNAL_SPARSE)
+    {
+      memset(block, 0, myVCB->block_size);
+      for (uint32_t i = 0; i + 3 <= rec.length; i += 3)
+      {
+        unsigned int offset = (unsigned char)p[i] | ((unsigned char)p[i + 1] << 8);
+        block[offset] = p[i + 2];
+      }
+      cacheWrite(block, 1, rec.lba);
+    }
+    p += rec.length;
+  }
+}
+
+// Follows the transactions committed since the last checkpoint, applying
+// them to the cached home blocks if apply is set. Returns how many there
+// are, -1 if the journal cannot be read
+static int scanJournal(int apply)
+{
+  char *block = malloc(myVCB->block_size);
+  char *tx = malloc(BLOCKS_TO_BYTES(ringBlocks()));
+  if (block == NULL || tx == NULL || fs_LBAread(block, 1, myVCB->journalLocation) != 1)
+  {
+    free(block);
+    free(tx);
+    return -1;
+  }
+  memcpy(&journalSuper, block, sizeof(JournalSuper));
+
+  if (journalSuper.magic != JOURNAL_MAGIC || journalSuper.version != JOURNAL_VERSION)
+  {
+    printf("The journal superblock is damaged\n");
+    free(block);
+    free(tx);
+    return -1;
+  }
+
+  // follow the transactions from the tail while the sequence numbers
+  // run on, reading at most the whole ring
+  uint32_t ring = ringBlocks();
+  uint32_t pos = journalSuper.tail;
+  uint64_t seq = journalSuper.sequence;
+  uint32_t consumed = 0;
+  int replayed = 0;
+
+  while (consumed < ring)
+  {
+    uint32_t blocks = readTx(pos, seq, tx);
+
+    // a transaction that did not fit before the end of the ring starts
+    // at its beginning
+    if (blocks == 0 && pos != 0)
+    {
+      blocks = readTx(0, seq, tx);
+      if (blocks != 0)
+      {
+        consumed += ring - pos;
+        pos = 0;
+      }
+    }
+    if (blocks == 0 || consumed + blocks > ring)
+    {
+      break;
+    }
+
+    if (apply)
+    {
+      applyTx(tx, block);
+    }
+    consumed += blocks;
+    pos = (pos + blocks) % ring;
+    seq++;
+    replayed++;
+  }
+  free(block);
+  free(tx);
+
+  ringHead = pos;
+  nextSequence = seq;
+  return replayed;
+}
+
+int replayJournal()
+{
+  int replayed = scanJournal(1);
+  if (replayed == -1)
+  {
+    return -1;
+  }
+
+  // the home blocks are up to date, the journal starts over empty
+  flushAllBuffers();
+  journalSuper.tail = ringHead;
+  journalSuper.sequence = nextSequence;
+  ringUsed = 0;
+
+  STAT_ADD(journal_replays, replayed);
+  if (replayed > 0)
+  {
+    printf("Replayed %d journal transactions\n", replayed);
+  }
+  return writeSuper();
+}
+
+int journalPending()
+{
+  return scanJournal(0);
+}
+
+int startJournal()
+{
+  txLimitBlocks = ringBlocks() / 4;
+  if (txLimitBlocks < 2)
+  {
+    txLimitBlocks = 2;
+  }
+  txLimit = BLOCKS_TO_BYTES(txLimitBlocks) - sizeof(JournalTx);
+
+  txBuffer = malloc(BLOCKS_TO_BYTES(txLimitBlocks));
+  shadowVCB = malloc(myVCB->block_size);
+  sparseData = malloc(myVCB->block_size);
+  if (txBuffer == NULL || shadowVCB == NULL || sparseData == NULL)
+  {
+    perror("Failed to allocate the journal");
+    return -1;
+  }
+
+  memcpy(shadowVCB, myVCB, myVCB->block_size);
+  txBytes = 0;
+  txOps = 0;
+  journalRunning = 1;
+  return 0;
+}
+
+// Writes the home blocks of everything committed and moves the tail up
+// to the head, the ring is free again. Called between transactions, when
+// no buffer is held. The VCB may be ahead of the journal in the middle
+// of an operation, so its copy as last logged goes home.
+static void checkpoint()
+{
+  flushAllBuffers();
+  if (fs_LBAwrite(shadowVCB, 1, 0) != 1)
+  {
+    perror("LBAwrite failed when writing the VCB\n");
+  }
+
+  journalSuper.tail = ringHead;
+  journalSuper.sequence = nextSequence;
+  writeSuper();
+  ringUsed = 0;
+  STAT_INC(journal_checkpoints);
+}
+
+// Writes the transaction being built to the ring
+static int writeTx()
+{
+  if (txBytes == 0)
+  {
+    releaseHeldBuffers();
+    return 0;
+  }
+
+  uint32_t ring = ringBlocks();
+  uint32_t blocks = get_num_blocks(sizeof(JournalTx) + txBytes, myVCB->block_size);
+
+  // a transaction is never split over the end of the ring
+  uint32_t waste = ringHead + blocks > ring ? ring - ringHead : 0;
+  if (waste > 0)
+  {
+    ringHead = 0;
+    ringUsed += waste;
+  }
+
+  JournalTx header;
+  header.magic = JOURNAL_TX_MAGIC;
+  header.blocks = blocks;
+  header.sequence = nextSequence;
+  header.bytes = txBytes;
+  header.checksum = 0;
+  memcpy(txBuffer, &header, sizeof(JournalTx));
+  memset(txBuffer + sizeof(JournalTx) + txBytes, 0,
+         BLOCKS_TO_BYTES(blocks) - sizeof(JournalTx) - txBytes);
+  header.checksum = checksum(FNV_OFFSET, txBuffer, sizeof(JournalTx) + txBytes);
+  memcpy(txBuffer, &header, sizeof(JournalTx));
+
+  if (fs_LBAwrite(txBuffer, blocks, ringLba(ringHead)) != blocks)
+  {
+    perror("LBAwrite failed when writing the journal\n");
+    return -1;
+  }
+
+  ringHead = (ringHead + blocks) % ring;
+  ringUsed += blocks;
+  nextSequence++;
+  txBytes = 0;
+
+  // the blocks the transaction covers may go home now
+  releaseHeldBuffers();
+  STAT_INC(journal_commits);
+  STAT_ADD(journal_blocks, blocks);
+
+  // keep room for the largest transaction and the end of the ring it
+  // may skip
+  if (ringUsed + 2 * txLimitBlocks > ring)
+  {
+    checkpoint();
+  }
+  return 0;
+}
+
+static void appendRecord(uint64_t lba, uint64_t offset, uint32_t type,
+                         const void *data, uint64_t length)
+{
+  uint64_t needed = sizeof(JournalRecord) + length;
+
+  // an operation too big for one transaction is committed in pieces
+  if (txBytes + needed > txLimit)
+  {
+    if (txCommitting)
+    {
+      writeTx();
+    }
+    else
+    {
+      journalCommit();
+    }
+  }
+
+  JournalRecord rec;
+  rec.lba = lba;
+  rec.offset = offset;
+  rec.length = length;
+  rec.type = type;
+  rec.reserved = 0;
+
+  char *p = txBuffer + sizeof(JournalTx) + txBytes;
+  memcpy(p, &rec, sizeof(JournalRecord));
+  memcpy(p + sizeof(JournalRecord), data, length);
+  txBytes += needed;
+  STAT_INC(journal_records);
+}
+
+int journalLog(uint64_t lba, uint64_t offset, const void *data, uint64_t length)
+{
+  if (!journalRunning)
+  {
+    return 0;
+  }
+
+  appendRecord(lba, offset, JOURNAL_BYTES, data, length);
+  return 1;
+}
+
+int journalLogBlock(uint64_t lba, const void *data)
+{
+  if (!journalRunning)
+  {
+    return 0;
+  }
+
+  // a mostly empty block is logged as its nonzero bytes. Their offsets
+  // take 2 bytes, so larger blocks are always logged whole
+  const unsigned char *bytes = data;
+  uint64_t length = myVCB->block_size > JOURNAL_SPARSE_MAX_BLOCK ? myVCB->block_size : 0;
+  for (uint64_t i = 0; i < myVCB->block_size && length <= myVCB->block_size / 2; i++)
+  {
+    if (bytes[i] != 0)
+    {
+      sparseData[length++] = i & 0xFF;
+      sparseData[length++] = (i >> 8) & 0xFF;
+      sparseData[length++] = bytes[i];
+    }
+  }
+
+  if (length <= myVCB->block_size / 2)
+  {
+    appendRecord(lba, 0, JOURNAL_SPARSE, sparseData, length);
+  }
+  else
+  {
+    appendRecord(lba, 0, JOURNAL_BYTES, data, myVCB->block_size);
+  }
+  return 1;
+}
+
+// Logs the bytes of blocks that differ from their shadow and brings the
+// shadow up to date. Changes closer together than a record header are
+// logged as one run.
+static void logChanges(uint64_t lba, const char *now, char *shadow, uint64_t blocks)
+{
+  uint64_t size = myVCB->block_size;
+
+  for (uint64_t b = 0; b < blocks; b++)
+  {
+    const char *cur = now + BLOCKS_TO_BYTES(b);
+    char *old = shadow + BLOCKS_TO_BYTES(b);
+    if (memcmp(cur, old, size) == 0)
+    {
+      continue;
+    }
+
+    uint64_t i = 0;
+    while (i < size)
+    {
+      if (cur[i] == old[i])
+      {
+        i++;
+        continue;
+      }
+
+      uint64_t start = i;
+      uint64_t end = i + 1;
+      for (uint64_t j = end; j < size && j - end < sizeof(JournalRecord); j++)
+      {
+        if (cur[j] != old[j])
+        {
+          end = j + 1;
+        }
+      }
+
+      appendRecord(lba + b, start, JOURNAL_BYTES, cur + start, end - start);
+      memcpy(old + start, cur + start, end - start);
+      i = end;
+    }
+  }
+}
+
+int journalCommit()
+{
+  if (!journalRunning || txCommitting)
+  {
+    return 0;
+  }
+
+  txCommitting = 1;
+  logChanges(0, (const char *)myVCB, shadowVCB, 1);
+  int result = writeTx();
+  txCommitting = 0;
+  txOps = 0;
+  return result;
+}
+
+int journalCheckpoint()
+{
+  if (!journalRunning)
+  {
+    return 0;
+  }
+
+  int result = journalCommit();
+  if (ringUsed > 0)
+  {
+    checkpoint();
+  }
+  return result;
+}
+
+void journalEndOp()
+{
+  if (!journalRunning)
+  {
+    return;
+  }
+
+  if (++txOps >= JOURNAL_GROUP_OPS)
+  {
+    journalCommit();
+  }
+}
+
+void stopJournal()
+{
+  if (!journalRunning)
+  {
+    return;
+  }
+
+  journalCommit();
+  if (ringUsed > 0)
+  {
+    checkpoint();
+  }
+  journalRunning = 0;
+
+  free(txBuffer);
+  txBuffer = NULL;
+  free(shadowVCB);
+  shadowVCB = NULL;
+  free(sparseData);
+  sparseData = NULL;
+}
@@ -0,0 +1,113 @@
+/**************************************************************
+ * Class::  CSC-415-02 Spring 2024
+ * Name:: Thiha Aung, Min Ye Thway Khaing, Dylan Nguyen
+ * GitHub-Name:: thihaaung32
+ * Group-Name:: Bee
+ * Project:: Basic File System
+ *
+ * File:: journal.h
+ *
+ * Description:: Interface of the metadata journal. Every change to
+ *            a metadata block is logged as a record of the bytes
+ *            that changed, and records are committed to a circular
+ *            region of the volume many operations at a time. The
+ *            home blocks are written lazily, at checkpoints, and a
+ *            mount replays the transactions committed since the last
+ *            one.
+ *
+ *	The journal region is a superblock followed by a ring of
+ *	blocks. A transaction is a JournalTx header followed by its
+ *	records, written with one LBAwrite. It counts only if its
+ *	sequence number is the next one and its checksum matches, so a
+ *	transaction cut short by a crash is ignored.
+ *
+ *	The buffer cache holds back blocks with uncommitted records, so
+ *	a home block never gets ahead of the journal.
+ *
+ **************************************************************/
+
+#ifndef _JOURNAL_H
+#define _JOURNAL_H
+
+#include "structure.h"
+
+#define JOURNAL_MAGIC 0x4C4E524A    // "JRNL", marks the journal superblock
+#define JOURNAL_TX_MAGIC 0x5854524A // "JRTX", marks a transaction header
+#define JOURNAL_VERSION 1
+
+#define JOURNAL_MIN_BYTES (128 * 1024)       // smallest journal region
+#define JOURNAL_MAX_BYTES (8 * 1024 * 1024)  // largest journal region
+#define JOURNAL_VOLUME_SHARE 64              // 1/64 of the volume between the two
+#define JOURNAL_MIN_BLOCKS 8                 // fewest blocks a journal gets
+#define JOURNAL_GROUP_OPS 32                 // operations committed together
+
+// Record types
+#define JOURNAL_BYTES 1  // length bytes to copy to the block at offset
+#define JOURNAL_SPARSE 2 // a zeroed block, the data is (offset, byte) triples
+
+#define JOURNAL_SPARSE_MAX_BLOCK 65536 // largest block a 2-byte sparse offset reaches
+
+// First block of the journal region
+typedef struct
+{
+  uint32_t magic;    // JOURNAL_MAGIC
+  uint32_t version;  // JOURNAL_VERSION
+  uint32_t tail;     // ring block of the oldest transaction not checkpointed
+  uint32_t reserved;
+  uint64_t sequence; // sequence number of that transaction
+} JournalSuper;
+
+// Header of a committed transaction
+typedef struct
+{
+  uint32_t magic;    // JOURNAL_TX_MAGIC
+  uint32_t blocks;   // ring blocks the transaction occupies
+  uint64_t sequence; // one more than the transaction before it
+  uint64_t bytes;    // bytes of records after the header
+  uint64_t checksum; // FNV-1a of the header, with 0 here, and the records
+} JournalTx;
+
+// One change to a home block, followed by its data
+typedef struct
+{
+  uint64_t lba;    // home block
+  uint32_t offset; // first byte changed
+  uint32_t length; // bytes of data that follow
+  uint32_t type;   // JOURNAL_BYTES or JOURNAL_SPARSE
+  uint32_t reserved;
+} JournalRecord;
+
+// allocates the journal of a new volume, 0 on success
+int initJournal();
+
+// applies the transactions committed since the last checkpoint and
+// empties the journal, call at mount before the VCB and map are loaded
+int replayJournal();
+
+// Counts the transactions a mount would replay, without applying them
+// or writing anything. Returns -1 if the journal cannot be read
+int journalPending();
+
+// starts logging, call once the VCB and free space map are in memory
+int startJournal();
+
+// commits, checkpoints and stops logging, call at unmount
+void stopJournal();
+
+// Log a change the buffer cache is about to make. Returns 1 if the
+// change was logged and the block must be held until the next commit,
+// 0 if the journal is not running.
+int journalLog(uint64_t lba, uint64_t offset, const void *data, uint64_t length);
+int journalLogBlock(uint64_t lba, const void *data);
+
+// An operation is complete, its changes are committed with the next group
+void journalEndOp();
+
+// Commits everything logged so far
+int journalCommit();
+
+// Commits and checkpoints, so no record in the journal is replayed over
+// blocks about to go back on the free chain
+int journalCheckpoint();
+
+#endif
@@ -1,55 +1,403 @@
 #include "memo.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "structure.h"
+#include "fsStats.h"
+#include "journal.h"
 
-// Global buffer cache
-Buffer buffers[MAX_BUFFERS];
+#define FLUSH_RUN_BLOCKS 64  // longest run of blocks written with one LBAwrite
+
+// Runtime block geometry
+uint64_t blockSize;
+int blockShift;
+uint64_t blockMask;
+
+// Global buffer cache, sized at runtime from the volume's block size
+Buffer *buffers = NULL;
+int numBuffers = 0;
+int *hashHeads = NULL;    // first buffer of each hash chain, -1 if empty
+uint64_t hashMask = 0;
+int clockHand = 0;
+char *bufferMemory = NULL;
+
+// Record the volume's block size, it must be a power of two
+int setBlockSize(uint64_t size) {
+    if (size == 0 || (size & (size - 1)) != 0) {
+        printf("Block size %lu is not a power of two\n", size);
+        return -1;
+    }
+
+    blockSize = size;
+    blockMask = size - 1;
+    blockShift = 0;
+    while (((uint64_t)1 << blockShift) < size) {
+        blockShift++;
+    }
+    return 0;
+}
 
 // Initialize the buffer cache
-void initBuffers() {
-    for (int i = 0; i < MAX_BUFFERS; i++) {
+int initBuffers() {
+    numBuffers = CACHE_BYTES / blockSize;
+    if (numBuffers < MIN_BUFFERS) {
+        numBuffers = MIN_BUFFERS;
+    }
+
+    // one hash chain per buffer on average, rounded up to a power of two
+    uint64_t numBuckets = 1;
+    while (numBuckets < (uint64_t)numBuffers) {
+        numBuckets <<= 1;
+    }
+    hashMask = numBuckets - 1;
+
+    buffers = malloc(numBuffers * sizeof(Buffer));
+    hashHeads = malloc(numBuckets * sizeof(int));
+    bufferMemory = aligned_alloc(CACHE_LINE_BYTES, BLOCKS_TO_BYTES(numBuffers));
+    if (buffers == NULL || hashHeads == NULL || bufferMemory == NULL) {
+        perror("Failed to allocate the buffer cache");
+        freeBuffers();
+        return -1;
+    }
+
+    for (uint64_t i = 0; i < numBuckets; i++) {
+        hashHeads[i] = -1;
+    }
+
+    for (int i = 0; i < numBuffers; i++) {
+        buffers[i].data = bufferMemory + BLOCKS_TO_BYTES(i);
         buffers[i].dirty = false;
+        buffers[i].referenced = false;
+        buffers[i].held = false;
+        buffers[i].hashNext = -1;
         buffers[i].blockNumber = -1;  // Indicates that the buffer is initially unused
     }
+    clockHand = 0;
+    return 0;
+}
+
+// Release the memory of the buffer cache, call flushAllBuffers first
+void freeBuffers() {
+    free(buffers);
+    buffers = NULL;
+    free(hashHeads);
+    hashHeads = NULL;
+    free(bufferMemory);
+    bufferMemory = NULL;
+    numBuffers = 0;
+}
+
+// Find the buffer holding a block, -1 if it is not cached
+static int findBuffer(uint64_t lba) {
+    int i = hashHeads[lba & hashMask];
+    while (i != -1 && buffers[i].blockNumber != (long)lba) {
+        i = buffers[i].hashNext;
+    }
+    return i;
+}
+
+// Take a buffer out of its hash chain
+static void unhashBuffer(int index) {
+    int *link = &hashHeads[buffers[index].blockNumber & hashMask];
+    while (*link != index) {
+        link = &buffers[*link].hashNext;
+    }
+    *link = buffers[index].hashNext;
+    buffers[index].hashNext = -1;
+    buffers[index].blockNumber = -1;
+}
+
+// Pick a buffer to reuse with the clock algorithm, writing it back if dirty.
+// Buffers held for the journal are passed over.
+static int evictBuffer() {
+    int scanned = 0;
+    while (buffers[clockHand].referenced || buffers[clockHand].held) {
+        buffers[clockHand].referenced = false;
+        clockHand = (clockHand + 1) % numBuffers;
+
+        // every buffer is waiting for a commit, commit to release them
+        if (++scanned > 2 * numBuffers) {
+            journalCommit();
+            scanned = 0;
+        }
+    }
+
+    int victim = clockHand;
+    clockHand = (clockHand + 1) % numBuffers;
+
+    if (buffers[victim].blockNumber != -1) {
+        if (buffers[victim].dirty) {
+            writeBlockToDisk(buffers[victim].blockNumber, buffers[victim].data);
+            buffers[victim].dirty = false;
+        }
+        unhashBuffer(victim);
+        STAT_INC(cache_evictions);
+    }
+    return victim;
+}
+
+// Get the buffer for a block, claiming a new one if it is not cached
+static int claimBuffer(uint64_t lba) {
+    int index = findBuffer(lba);
+    if (index != -1) {
+        return index;
+    }
+
+    index = evictBuffer();
+    uint64_t bucket = lba & hashMask;
+    buffers[index].blockNumber = lba;
+    buffers[index].hashNext = hashHeads[bucket];
+    hashHeads[bucket] = index;
+    return index;
+}
+
+// Read blocks through the cache. Runs of missing blocks are read with
+// one LBAread straight into the caller's buffer and then cached.
+uint64_t cacheRead(void *buffer, uint64_t count, uint64_t lba) {
+    char *dest = buffer;
+    uint64_t i = 0;
+
+    while (i < count) {
+        int index = findBuffer(lba + i);
+        if (index != -1) {
+            copyBlocks(dest + BLOCKS_TO_BYTES(i), buffers[index].data, 1);
+            buffers[index].referenced = true;
+            STAT_INC(cache_hits);
+            i++;
+            continue;
+        }
+
+        // gather the run of blocks that are not cached
+        uint64_t run = 1;
+        while (i + run < count && findBuffer(lba + i + run) == -1) {
+            run++;
+        }
+
+        if (fs_LBAread(dest + BLOCKS_TO_BYTES(i), run, lba + i) != run) {
+            perror("cacheRead: LBAread failed\n");
+            return i;
+        }
+        STAT_ADD(cache_misses, run);
+
+        for (uint64_t j = i; j < i + run; j++) {
+            index = claimBuffer(lba + j);
+            copyBlocks(buffers[index].data, dest + BLOCKS_TO_BYTES(j), 1);
+            buffers[index].referenced = true;
+        }
+        i += run;
+    }
+    return count;
+}
+
+// Write blocks into the cache, they reach the disk when evicted or flushed
+uint64_t cacheWrite(void *buffer, uint64_t count, uint64_t lba) {
+    const char *src = buffer;
+
+    for (uint64_t i = 0; i < count; i++) {
+        int index = claimBuffer(lba + i);
+        if (journalLogBlock(lba + i, src + BLOCKS_TO_BYTES(i))) {
+            buffers[index].held = true;
+        }
+        copyBlocks(buffers[index].data, src + BLOCKS_TO_BYTES(i), 1);
+        buffers[index].dirty = true;
+        buffers[index].referenced = true;
+    }
+    return count;
+}
+
+// Read length bytes starting offset bytes into block lba, the range may
+// span several blocks. Only the bytes asked for are copied.
+int cacheReadBytes(void *buffer, uint64_t lba, uint64_t offset, uint64_t length) {
+    char *dest = buffer;
+
+    lba += BLOCK_INDEX(offset);
+    offset = BLOCK_OFFSET(offset);
+
+    while (length > 0) {
+        uint64_t chunk = blockSize - offset;
+        if (chunk > length) {
+            chunk = length;
+        }
+
+        int index = findBuffer(lba);
+        if (index != -1) {
+            STAT_INC(cache_hits);
+        } else {
+            index = claimBuffer(lba);
+            if (fs_LBAread(buffers[index].data, 1, lba) != 1) {
+                unhashBuffer(index);
+                perror("cacheReadBytes: LBAread failed\n");
+                return -1;
+            }
+            STAT_INC(cache_misses);
+        }
+        buffers[index].referenced = true;
+        memcpy(dest, buffers[index].data + offset, chunk);
+
+        dest += chunk;
+        length -= chunk;
+        offset = 0;
+        lba++;
+    }
+    return 0;
+}
+
+// Write length bytes starting offset bytes into block lba. Blocks that are
+// only partly covered are read first so the rest of the block is kept.
+int cacheWriteBytes(const void *buffer, uint64_t lba, uint64_t offset, uint64_t length) {
+    const char *src = buffer;
+
+    lba += BLOCK_INDEX(offset);
+    offset = BLOCK_OFFSET(offset);
+
+    while (length > 0) {
+        uint64_t chunk = blockSize - offset;
+        if (chunk > length) {
+            chunk = length;
+        }
+
+        int index = findBuffer(lba);
+        bool loaded = true;
+        if (index == -1) {
+            index = claimBuffer(lba);
+            loaded = chunk < blockSize;
+            if (loaded && fs_LBAread(buffers[index].data, 1, lba) != 1) {
+                unhashBuffer(index);
+                perror("cacheWriteBytes: LBAread failed\n");
+                return -1;
+            }
+            STAT_INC(cache_misses);
+        } else {
+            STAT_INC(cache_hits);
+        }
+
+        // only the bytes that change are logged. A whole block claimed
+        // without a read still holds another block's bytes, which say
+        // nothing about the disk, so the whole block is logged
+        uint64_t first = 0;
+        uint64_t last = chunk;
+        while (loaded && first < last && buffers[index].data[offset + first] == src[first]) {
+            first++;
+        }
+        while (loaded && last > first && buffers[index].data[offset + last - 1] == src[last - 1]) {
+            last--;
+        }
+        if (first < last &&
+            journalLog(lba, offset + first, src + first, last - first)) {
+            buffers[index].held = true;
+        }
+
+        memcpy(buffers[index].data + offset, src, chunk);
+        buffers[index].dirty = true;
+        buffers[index].referenced = true;
+
+        src += chunk;
+        length -= chunk;
+        offset = 0;
+        lba++;
+    }
+    return 0;
 }
 
+// Drop cached copies of blocks that were released, without writing them
+void invalidateBuffers(uint64_t lba, uint64_t count) {
+    if (buffers == NULL) {
+        return;
+    }
 
-// Flush all buffers in the buffer cache
+    for (uint64_t i = 0; i < count; i++) {
+        int index = findBuffer(lba + i);
+        if (index != -1) {
+            buffers[index].dirty = false;
+            buffers[index].referenced = false;
+            buffers[index].held = false;
+            unhashBuffer(index);
+        }
+    }
+}
+
+// order dirty buffers by block number so neighbours can be written together
+static int compareBlockNumbers(const void *a, const void *b) {
+    long left = buffers[*(const int *)a].blockNumber;
+    long right = buffers[*(const int *)b].blockNumber;
+    return (left > right) - (left < right);
+}
+
+// Flush all buffers in the buffer cache, coalescing adjacent blocks.
+// Buffers held for the journal stay dirty until their commit.
 void flushAllBuffers() {
-    for (int i = 0; i < MAX_BUFFERS; i++) {
+    if (buffers == NULL) {
+        return;
+    }
+
+    int *dirty = malloc(numBuffers * sizeof(int));
+    char *run = malloc(BLOCKS_TO_BYTES(FLUSH_RUN_BLOCKS));
+    int dirtyCount = 0;
+
+    for (int i = 0; i < numBuffers; i++) {
+        if (buffers[i].dirty && !buffers[i].held) {
+            dirty[dirtyCount++] = i;
+        }
+    }
+    qsort(dirty, dirtyCount, sizeof(int), compareBlockNumbers);
+
+    int i = 0;
+    while (i < dirtyCount) {
+        long start = buffers[dirty[i]].blockNumber;
+        int length = 0;
+
+        // stage a run of consecutive blocks and write it with one call
+        while (i + length < dirtyCount && length < FLUSH_RUN_BLOCKS &&
+               buffers[dirty[i + length]].blockNumber == start + length) {
+            copyBlocks(run + BLOCKS_TO_BYTES(length),
+                       buffers[dirty[i + length]].data, 1);
+            buffers[dirty[i + length]].dirty = false;  // Clear the dirty flag
+            length++;
+        }
+
+        if (fs_LBAwrite(run, length, start) != (uint64_t)length) {
+            printf("Error writing blocks %ld to %ld\n", start, start + length - 1);
+        }
+        STAT_ADD(cache_writebacks, length);
+        i += length;
+    }
+
+    free(dirty);
+    free(run);
+}
+
+// The journal committed the changes of every held buffer, they may be
+// written back now
+void releaseHeldBuffers() {
+    for (int i = 0; i < numBuffers; i++) {
+        buffers[i].held = false;
+    }
+}
+
+// Count the buffers that still have to be written back
+int countDirtyBuffers() {
+    int count = 0;
+    for (int i = 0; i < numBuffers; i++) {
         if (buffers[i].dirty) {
-            writeBlockToDisk(buffers[i].blockNumber, buffers[i].data);
-            buffers[i].dirty = false;  // Clear the dirty flag
+            count++;
         }
     }
-    printf("All buffers have been flushed.\n");
+    return count;
 }
 
 void writeBackMetadata() {
-    
+
     printf("Writing back metadata to the disk...\n");
     flushAllBuffers();  // Ensure all modified buffers are written back
+    printf("All buffers have been flushed.\n");
 }
 
 // Write a block of data to the disk
-void writeBlockToDisk(int blockNumber, const char* data) {
-    // Ensure block size is dynamically pulled from VCB
-    diskDeviceWrite(blockNumber, data, myVCB->block_size);
-    printf("Block %d written to disk.\n", blockNumber);
-}
-
-// Disk write operation that writes data to a physical file (simulated disk block)
-void diskDeviceWrite(int blockNumber, const char* data, size_t size) {
-    char filename[30];
-    sprintf(filename, "diskBlock_%d.bin", blockNumber);
-    FILE *file = fopen(filename, "wb");
-    if (file) {
-        fwrite(data, size, 1, file);
-        fclose(file);
-    } else {
-        printf("Error writing to disk block %d\n", blockNumber);
+void writeBlockToDisk(long blockNumber, const char* data) {
+    if (fs_LBAwrite((void *)data, 1, blockNumber) != 1) {
+        printf("Error writing to disk block %ld\n", blockNumber);
     }
+    STAT_INC(cache_writebacks);
 }
 
 // Close all open files
@@ -2,17 +2,28 @@
 #ifndef MEMO_H
 #define MEMO_H
 
-#include <stdbool.h>  
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <sys/types.h>
 
-#define BLOCK_SIZE 512  // Define according to your disk block size
-#define MAX_BUFFERS 1024  // Maximum number of buffers in the buffer cache
+#ifndef uint64_t
+typedef u_int64_t uint64_t;
+#endif
+
+#define CACHE_BYTES (4 * 1024 * 1024)  // memory given to the buffer cache
+#define MIN_BUFFERS 64  // never run with fewer buffers than this
 #define MAX_OPEN_FILES 128
+#define CACHE_LINE_BYTES 64  // block data in the cache starts on a line
 
-// Buffer structure definition
+// Buffer structure definition, data is one volume block
 typedef struct {
-    char data[BLOCK_SIZE];
-    int blockNumber;
+    char *data;
+    long blockNumber;   // -1 when the buffer is unused
     bool dirty;
+    bool referenced;    // second chance bit for the clock eviction
+    bool held;          // has changes the journal has not committed yet
+    int hashNext;       // next buffer in the same hash chain
 } Buffer;
 
 //File descriptor structure definition
@@ -23,16 +34,58 @@ typedef struct{
 
 } FileDescriptor;
 
+// Runtime block geometry, set once the volume's block size is known.
+// Block sizes are powers of two so offsets split with a shift and mask.
+extern uint64_t blockSize;
+extern int blockShift;
+extern uint64_t blockMask;
+
+#define BLOCK_INDEX(offset) ((uint64_t)(offset) >> blockShift)
+#define BLOCK_OFFSET(offset) ((uint64_t)(offset) & blockMask)
+#define BLOCKS_TO_BYTES(count) ((uint64_t)(count) << blockShift)
+
+// copy n bytes of a fixed block size; a constant length lets the
+// compiler unroll the copy instead of calling into memcpy's dispatch
+#define COPY_FIXED_BLOCKS(dst, src, count, size)                  \
+    for (uint64_t _b = 0; _b < (count); _b++)                     \
+        memcpy((char *)(dst) + _b * (size),                       \
+               (const char *)(src) + _b * (size), (size))
+
+// Copy whole blocks, with fast paths for the common block sizes
+static inline void copyBlocks(void *dst, const void *src, uint64_t count) {
+    switch (blockSize) {
+        case 512:
+            COPY_FIXED_BLOCKS(dst, src, count, 512);
+            break;
+        case 4096:
+            COPY_FIXED_BLOCKS(dst, src, count, 4096);
+            break;
+        case 65536:
+            COPY_FIXED_BLOCKS(dst, src, count, 65536);
+            break;
+        default:
+            memcpy(dst, src, BLOCKS_TO_BYTES(count));
+            break;
+    }
+}
 
 // Function prototypes
 extern FileDescriptor fileDescriptors[MAX_OPEN_FILES];
 
-void initBuffers();
+int setBlockSize(uint64_t size);
+int initBuffers();
+void freeBuffers();
+uint64_t cacheRead(void *buffer, uint64_t count, uint64_t lba);
+uint64_t cacheWrite(void *buffer, uint64_t count, uint64_t lba);
+int cacheReadBytes(void *buffer, uint64_t lba, uint64_t offset, uint64_t length);
+int cacheWriteBytes(const void *buffer, uint64_t lba, uint64_t offset, uint64_t length);
+void invalidateBuffers(uint64_t lba, uint64_t count);
 void flushAllBuffers();
-void writeBlockToDisk(int blockNumber, const char* data);
-void diskDeviceWrite(int blockNumber, const char* data, size_t size);
+void releaseHeldBuffers();
+void writeBlockToDisk(long blockNumber, const char* data);
 void closeAllOpenFiles();
-void writeBackMetadata();  
+void writeBackMetadata();
+int countDirtyBuffers();
 
 
 #endif // MEMO_H
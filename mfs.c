@@ -16,131 +16,419 @@
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
+#include <fnmatch.h>
+#include <errno.h>
 #include "fsLow.h"
 #include "freeSpaceManagement.h"
 
-// Returns an array of directory entries
-DirectoryEntry *parsePath(const char *path)
+// Walks every component of the path except the last one and returns the
+// location of the directory holding the last component, or -1 if a
+// component is missing or is not a directory. Directories are only read
+// for components the dentry cache does not know yet. A relative path
+// starts at the directory at start.
+long resolveParentAt(uint64_t start, const ParsedPath *path)
 {
+  STAT_INC(path_lookups);
 
-  char *pathname = malloc(strlen(path) + 1);
-  strcpy(pathname, path);
+  /*if the path starts with '/', the walk starts at the root directory.*/
+  long location = path->absolute ? myVCB->rootDirLocation : start;
 
-  // malloc a directory entry array
-  int num_blocks = get_num_blocks(sizeof(DirectoryEntry) * DE_COUNT, myVCB->block_size);
-  int num_bytes = num_blocks * myVCB->block_size;
-  DirectoryEntry *dirArray = malloc(num_bytes);
+  // check if the directory exists through the components.
+  for (int i = 0; i < path->count - 1 && location != -1; i++)
+  {
+    const char *name = path->component[i];
+    const Dentry *dentry = dcacheLookup(location, name);
+    unsigned char attributes;
+
+    if (dentry != NULL)
+    {
+      attributes = dentry->attributes;
+      location = dentry->location;
+    }
+    else
+    {
+      DirectoryEntry entry;
+      int found = get_de_index(location, name, &entry);
+      if (found < 0)
+      {
+        dcacheInsertNegative(location, name);
+        location = -1;
+        break;
+      }
+
+      dcacheInsert(location, name, found, &entry);
+      attributes = entry.attributes;
+      location = entry.location;
+    }
+
+    // a negative dentry has no attributes, so it ends the walk here too
+    if (attributes != 'd')
+    {
+      location = -1;
+    }
+  }
 
-  /*if the path starts with '/', and the root directory must be loaded.*/
-  if (pathname[0] == '/')
+  return location;
+}
+
+// resolve a path relative to the current working directory
+long resolveParent(const ParsedPath *path)
+{
+  return resolveParentAt(cw_dir_location, path);
+}
+
+// Resolves the whole path and fills in the dentry of its last component.
+// Returns 0 on success, -1 if the path does not exist.
+int lookupPathAt(uint64_t start, const char *pathname, Dentry *result)
+{
+  ParsedPath path;
+  if (parsePath(pathname, &path) != 0)
   {
-    LBAread(dirArray, myVCB->root_blocks, myVCB->rootDirLocation);
+    return -1;
   }
-  else
+
+  long parent = resolveParentAt(start, &path);
+  if (parent == -1)
   {
-    memcpy(dirArray, cw_dir_array, num_bytes);
+    return -1;
   }
 
-  // malloc space for token array
-  char *last_token;
-  int token_counts = 0;
-  char **token_array = malloc(strlen(pathname) * sizeof(char *));
-  char *token = strtok_r(pathname, "/", &last_token);
+  const char *name = pathLast(&path);
+  const Dentry *dentry = dcacheLookup(parent, name);
 
-  while (token != NULL)
+  if (dentry == NULL)
   {
-    token_array[token_counts++] = token;
-    token = strtok_r(NULL, "/", &last_token);
+    // not cached yet, find it in the parent directory and remember it
+    DirectoryEntry entry;
+    int found = get_de_index(parent, name, &entry);
+    if (found < 0)
+    {
+      dcacheInsertNegative(parent, name);
+      return -1;
+    }
+
+    dentry = dcacheInsert(parent, name, found, &entry);
+    if (dentry == NULL)
+    {
+      result->parent = parent;
+      result->location = entry.location;
+      result->index = found;
+      result->attributes = entry.attributes;
+      result->name = NULL;
+      return 0;
+    }
   }
 
-  // check if the directory exists through the token array.
-  for (int i = 0; i < token_counts - 1; i++)
+  if (dentry->index == DENTRY_NEGATIVE)
   {
-    int found = get_de_index(token_array[i], dirArray);
+    return -1;
+  }
+  memcpy(result, dentry, sizeof(Dentry));
+  return 0;
+}
+
+// look up a path relative to the current working directory
+int lookupPath(const char *path, Dentry *result)
+{
+  return lookupPathAt(cw_dir_location, path, result);
+}
+
+// The current working directory is kept as the stack of directories on
+// its path, root excluded, so cd and pwd never read the disk
+typedef struct
+{
+  uint64_t location; // block location of the directory
+  char *name;        // name of the directory in its parent
+} CwdComponent;
+
+static CwdComponent *cwdStack = NULL;
+static int cwdDepth = 0;
+static int cwdCapacity = 0;
 
-    LBAread(dirArray, num_blocks, dirArray[found].location);
+static int cwdPush(uint64_t location, const char *name)
+{
+  if (cwdDepth == cwdCapacity)
+  {
+    int capacity = cwdCapacity == 0 ? 16 : cwdCapacity * 2;
+    CwdComponent *stack = realloc(cwdStack, capacity * sizeof(CwdComponent));
+    if (stack == NULL)
+    {
+      perror("cwdPush: realloc failed\n");
+      return -1;
+    }
+    cwdStack = stack;
+    cwdCapacity = capacity;
   }
 
-  free(pathname);
-  free(token_array);
+  cwdStack[cwdDepth].location = location;
+  cwdStack[cwdDepth].name = strdup(name);
+  cwdDepth++;
+  cw_dir_location = location;
+
+  return 0;
+}
+
+static void cwdPop()
+{
+  if (cwdDepth == 0)
+  {
+    return;
+  }
 
-  return dirArray;
+  cwdDepth--;
+  free(cwdStack[cwdDepth].name);
+  cwdStack[cwdDepth].name = NULL;
+  cw_dir_location = cwdDepth == 0 ? myVCB->rootDirLocation : cwdStack[cwdDepth - 1].location;
 }
 
-// interface to get the current working directory
-char *fs_getcwd(char *pathname, size_t size)
+// build the path string from the stack
+static void cwdFormat()
 {
-  
-  return get_cwd;
+  size_t length = 2;
+  for (int i = 0; i < cwdDepth; i++)
+  {
+    length += strlen(cwdStack[i].name) + 1;
+  }
+
+  if (length > MAX_PATH_LENGTH)
+  {
+    char *path = realloc(get_cwd, length);
+    if (path == NULL)
+    {
+      return;
+    }
+    get_cwd = path;
+  }
+
+  strcpy(get_cwd, "/");
+  for (int i = 0; i < cwdDepth; i++)
+  {
+    strcat(get_cwd, cwdStack[i].name);
+    if (i < cwdDepth - 1)
+    {
+      strcat(get_cwd, "/");
+    }
+  }
 }
 
-// interface to set the current working directory:
-int fs_setcwd(char *pathname)
+// Rebuild the stack from disk by walking up the ".." links, only needed
+// when a directory on the path is moved
+static void cwdRebuild()
 {
-  // if the pathname is the root directory, load the root directory
-  if (strcmp(pathname, "/") == 0)
+  uint64_t location = cw_dir_location;
+
+  while (cwdDepth > 0)
+  {
+    cwdPop();
+  }
+
+  DirHeader header;
+  CwdComponent *path = NULL;
+  int count = 0;
+
+  while (load_dir_header(location, &header) == 0 && header.location != header.parent)
   {
-    if (LBAread(cw_dir_array, myVCB->root_blocks, myVCB->rootDirLocation) != myVCB->root_blocks)
+    // find our name in the parent
+    DirectoryEntry entry;
+    int index = DE_FIRST_SLOT;
+    while (next_de(header.parent, &index, &entry) == 0)
     {
-      perror("LBAread failed when reading the directory\n");
+      if (entry.location == location)
+      {
+        break;
+      }
     }
 
-    set_cwd();
+    path = realloc(path, (count + 1) * sizeof(CwdComponent));
+    path[count].location = location;
+    path[count].name = strdup(entry.name);
+    count++;
 
-    return 0;
+    location = header.parent;
+  }
+
+  for (int i = count - 1; i >= 0; i--)
+  {
+    cwdPush(path[i].location, path[i].name);
+    free(path[i].name);
   }
+  free(path);
 
-  // load the directory of the path
-  DirectoryEntry *dirArray = parsePath(pathname);
+  cwdFormat();
+}
 
-  if (dirArray == NULL)
+// Called when a directory is moved, keeps the stack right if the
+// directory is on the current path
+void cwdMoved(uint64_t location, uint64_t old_parent, uint64_t new_parent, const char *name)
+{
+  for (int i = 0; i < cwdDepth; i++)
+  {
+    if (cwdStack[i].location != location)
+    {
+      continue;
+    }
+
+    // a rename in place only changes the component's name
+    if (old_parent == new_parent)
+    {
+      free(cwdStack[i].name);
+      cwdStack[i].name = strdup(name);
+      cwdFormat();
+    }
+    else
+    {
+      cwdRebuild();
+    }
+    return;
+  }
+}
+
+int cwdInside(uint64_t location)
+{
+  for (int i = 0; i < cwdDepth; i++)
+  {
+    if (cwdStack[i].location == location)
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// release the stack when the file system exits
+void freeCwd()
+{
+  while (cwdDepth > 0)
+  {
+    cwdPop();
+  }
+  free(cwdStack);
+  cwdStack = NULL;
+  cwdCapacity = 0;
+}
+
+// interface to get the current working directory
+char *fs_getcwd(char *pathname, size_t size)
+{
+
+  return get_cwd;
+}
+
+// interface to set the current working directory:
+int fs_setcwd(char *pathname)
+{
+  // walk the path on a scratch copy of the stack, so a bad path leaves
+  // the current directory alone. ".." and "." never touch the disk
+  ParsedPath path;
+  if (parsePath(pathname, &path) != 0)
   {
-    printf("Invalid path: %s\n", pathname);
     return -1;
   }
 
-  char *last_token = get_last_token(pathname);
+  int depth = path.absolute ? 0 : cwdDepth;
+  CwdComponent *walk = malloc((depth + path.count + 1) * sizeof(CwdComponent));
+  memcpy(walk, cwdStack, depth * sizeof(CwdComponent));
 
-  int found = get_de_index(last_token, dirArray);
+  int valid = 1;
 
-  // if not found, or not a directory
-  if (found == -1 || dirArray[found].attributes != 'd')
+  for (int i = 0; i < path.count && valid; i++)
+  {
+    const char *token = path.component[i];
+
+    if (strcmp(token, "..") == 0)
+    {
+      if (depth > 0)
+      {
+        depth--;
+      }
+    }
+    else if (strcmp(token, ".") != 0)
+    {
+      uint64_t parent = depth == 0 ? myVCB->rootDirLocation : walk[depth - 1].location;
+      const Dentry *cached = dcacheLookup(parent, token);
+      DirectoryEntry entry;
+
+      if (cached != NULL)
+      {
+        entry.location = cached->location;
+        entry.attributes = cached->attributes;
+      }
+      else
+      {
+        int found = get_de_index(parent, token, &entry);
+        if (found < 0)
+        {
+          dcacheInsertNegative(parent, token);
+          valid = 0;
+          break;
+        }
+        dcacheInsert(parent, token, found, &entry);
+      }
+
+      // if not a directory
+      if (entry.attributes != 'd')
+      {
+        valid = 0;
+        break;
+      }
+
+      walk[depth].location = entry.location;
+      walk[depth].name = (char *)token;
+      depth++;
+    }
+  }
+
+  if (!valid)
   {
     printf("No such file or directory with that name found.\n");
+    free(walk);
     return -1;
   }
 
-  // read the directory into the current working directory array
-  if (LBAread(cw_dir_array, dirArray[found].num_blocks,
-              dirArray[found].location) != dirArray[found].num_blocks)
+  // the names are copied before the old stack lets go of its own
+  for (int i = 0; i < depth; i++)
+  {
+    walk[i].name = strdup(walk[i].name);
+  }
+  while (cwdDepth > 0)
   {
-    perror("LBAread failed when reading the directory\n");
+    cwdPop();
   }
+  for (int i = 0; i < depth; i++)
+  {
+    cwdPush(walk[i].location, walk[i].name);
+    free(walk[i].name);
+  }
+
+  free(walk);
 
-  set_cwd();
+  cwdFormat();
 
   return 0;
 }
 
-int fs_mkdir(const char *pathname, mode_t mode)
+// create a directory, a relative path starts at the directory at start
+static int mkdirAt(uint64_t start, const char *pathname)
 {
-  // malloc pathname
-  char *path = malloc(strlen(pathname) + 1);
-  strcpy(path, pathname);
+  ParsedPath path;
+  if (parsePath(pathname, &path) != 0)
+  {
+    return -1;
+  }
 
-  // load the directory array
-  DirectoryEntry *dirArray = parsePath(path);
+  // locate the parent directory
+  long parent = resolveParentAt(start, &path);
 
-  if (dirArray == NULL)
+  if (parent == -1)
   {
-    printf("Invalid path: %s\n", path);
+    printf("Invalid path: %s\n", pathname);
     return -1;
   }
 
   // get last token of the path
-  char *last_token = get_last_token(path);
+  const char *last_token = pathLast(&path);
 
-  int found = get_de_index(last_token, dirArray);
+  int found = get_de_index(parent, last_token, NULL);
 
   // check if a file/directory already exists
   if (found > -1)
@@ -149,82 +437,125 @@ int fs_mkdir(const char *pathname, mode_t mode)
     return -1;
   }
 
-  // find an available directory entry location
-  int new_index = get_avail_de_idx(dirArray);
-
-  // no space left
-  if (new_index == -1)
+  // initialize a new directory as being the parent
+  int64_t new_location = initRootDirectory(parent);
+  if (new_location == -1)
   {
     return -1;
   }
 
-  // initialize a new directory as being the parent
-  int new_location = initRootDirectory(dirArray[0].location);
+  // New directory entry initialization
+  DirectoryEntry entry;
+  memset(&entry, 0, sizeof(DirectoryEntry));
+  entry.size = dirBytes;
+  entry.num_blocks = dirBlocks;
+  entry.location = new_location;
+  entry.timeCreated = time(NULL);
+  entry.timeLastModified = time(NULL);
+  entry.timeLastViewed = time(NULL);
+  entry.attributes = 'd';
+  strcpy(entry.name, last_token);
+
+  // a directory that is never added gives its blocks back
+  if (alloc_inode(&entry) != 0)
+  {
+    release_dirs(&entry.location, 1);
+    write_fs();
+    return -1;
+  }
 
-  // calculate the number of blocks and bytes this directory occupies
-  int num_blocks = get_num_blocks(sizeof(DirectoryEntry) * DE_COUNT, myVCB->block_size);
-  int num_bytes = num_blocks * myVCB->block_size;
+  // add the new directory to its parent
+  int new_index = insert_de(parent, &entry);
 
-  // New directory entry initialization
-  dirArray[new_index].size = num_bytes;
-  dirArray[new_index].num_blocks = num_blocks;
-  dirArray[new_index].location = new_location;
-  dirArray[new_index].timeCreated = time(NULL);
-  dirArray[new_index].timeLastModified = time(NULL);
-  dirArray[new_index].timeLastViewed = time(NULL);
-  dirArray[new_index].attributes = 'd';
-  strcpy(dirArray[new_index].name, last_token);
+  // no space left
+  if (new_index == -1)
+  {
+    free_inode(entry.inode);
+    release_dirs(&entry.location, 1);
+    write_fs();
+    return -1;
+  }
 
   // write new directory to file system
-  write_fs(dirArray);
-
-  // free the malloc'd in functions
-  free(dirArray);
-  free(last_token);
-  free(path);
+  write_fs();
+  dcacheInsert(parent, last_token, new_index, &entry);
 
   return new_location;
 };
 
+int fs_mkdir(const char *pathname, mode_t mode)
+{
+  return mkdirAt(cw_dir_location, pathname);
+}
+
+int fs_mkdirat(fdDir *dirp, const char *name, mode_t mode)
+{
+  if (dirp == NULL)
+  {
+    return -1;
+  }
+  return mkdirAt(dirp->directoryStartLocation, name);
+}
+
 // remove directory interface
 int fs_rmdir(const char *pathname)
 {
-  // malloc pathname
-  char *path = malloc(strlen(pathname) + 1);
-  strcpy(path, pathname);
+  ParsedPath path;
+  if (parsePath(pathname, &path) != 0)
+  {
+    return -1;
+  }
 
-  // load directory
-  DirectoryEntry *dirArray = parsePath(path);
+  // locate the parent directory
+  long parent = resolveParent(&path);
 
-  char *last_token = get_last_token(path);
+  const char *last_token = pathLast(&path);
 
-  int found = get_de_index(last_token, dirArray);
+  DirectoryEntry entry;
+  int found = parent == -1 ? -1 : get_de_index(parent, last_token, &entry);
 
   // must exist and be a directory
-  if (found < 2 || dirArray[found].attributes != 'd')
-  {
-    free(path);
-    path = NULL;
-    free(dirArray);
-    dirArray = NULL;
-    free(last_token);
-    last_token = NULL;
+  if (found < DE_FIRST_SLOT || entry.attributes != 'd')
+  {
     perror("fs_rmdir: remove directory failed.");
     return -1;
   }
 
-  // reset the name, size, avalility and num_blocks
-  dirArray[found].name[0] = '\0';
-  dirArray[found].num_blocks = 0;
-  dirArray[found].size = 0;
-  dirArray[found].attributes = 'a';
+  // only an empty directory is removed, the inodes of its entries would
+  // be lost. rm -r takes a tree apart with fs_remove_tree
+  DirHeader header;
+  if (load_dir_header(entry.location, &header) != 0)
+  {
+    return -1;
+  }
+  if (header.count > 0)
+  {
+    errno = ENOTEMPTY;
+    perror("fs_rmdir: directory is not empty");
+    return -1;
+  }
 
-  // write all changes to the file system to disk
-  write_fs(dirArray);
+  // its blocks are reused once it is gone
+  if (cwdInside(entry.location))
+  {
+    errno = EBUSY;
+    perror("fs_rmdir: directory is on the working path");
+    return -1;
+  }
 
-  free(path);
-  free(dirArray);
-  free(last_token);
+  // the directory and everything cached inside it are gone
+  dcacheRemove(parent, last_token);
+  dcachePurgeDir(entry.location);
+  bloomDrop(entry.location);
+  dirIndexDrop(entry.location);
+
+  // free the directory entry and its inode, then its blocks
+  remove_de(parent, last_token);
+  free_inode(entry.inode);
+  release_dirs(&entry.location, 1);
+
+  // write all changes to the file system to disk
+  write_fs();
 
   return 0;
 }
@@ -232,45 +563,39 @@ int fs_rmdir(const char *pathname)
 // delete file interface
 int fs_delete(char *filename)
 {
-  
-  char *path = malloc(strlen(filename) + 1);
-  strcpy(path, filename);
+  ParsedPath path;
+  if (parsePath(filename, &path) != 0)
+  {
+    return -1;
+  }
 
-  
-  DirectoryEntry *dirArray = parsePath(path);
+  long parent = resolveParent(&path);
 
-  char *last_token = get_last_token(path);
+  const char *last_token = pathLast(&path);
 
-  int found = get_de_index(last_token, dirArray);
+  DirectoryEntry entry;
+  int found = parent == -1 ? -1 : get_de_index(parent, last_token, &entry);
 
   // must exist and be a file
-  if (found < 2 || dirArray[found].attributes != 'f')
-  {
-    free(path);
-    path = NULL;
-    free(dirArray);
-    dirArray = NULL;
-    free(last_token);
-    last_token = NULL;
+  if (found < DE_FIRST_SLOT || entry.attributes != 'f')
+  {
     perror("Delete file failed.\n");
     return -1;
   }
 
-  // reset the name, size, space and num_blocks
-  dirArray[found].name[0] = '\0';
-  dirArray[found].num_blocks = 0;
-  dirArray[found].size = 0;
-  dirArray[found].attributes = 'a';
+  dcacheRemove(parent, last_token);
 
-  // write all changes to the file system to disk
-  write_fs(dirArray);
+  // free the directory entry and its inode, blocks shared with a clone
+  // lose a holder
+  remove_de(parent, last_token);
+  free_inode(entry.inode);
+  if (entry.num_blocks > 0)
+  {
+    release_chain(entry.location, entry.num_blocks);
+  }
 
-  free(path);
-  path = NULL;
-  free(dirArray);
-  dirArray = NULL;
-  free(last_token);
-  last_token = NULL;
+  // write all changes to the file system to disk
+  write_fs();
 
   return 0;
 }
@@ -278,18 +603,12 @@ int fs_delete(char *filename)
 // isFile interface
 int fs_isFile(char *filename)
 {
-  
-  DirectoryEntry *dirArray = parsePath(filename);
-  if (dirArray == NULL)
-  {
-    printf("Invalid File path.\n");
-    return 0;
-  }
 
-  int found_entry = get_de_index(get_last_token(filename), dirArray);
+  Dentry dentry;
 
   // must exist and be a file
-  if (found_entry < 2 || dirArray[found_entry].attributes != 'f')
+  if (lookupPath(filename, &dentry) != 0 || dentry.index < DE_FIRST_SLOT ||
+      dentry.attributes != 'f')
   {
     perror("File is not found\n");
     return 0;
@@ -300,16 +619,10 @@ int fs_isFile(char *filename)
 // isDir interface
 int fs_isDir(char *pathname)
 {
-  DirectoryEntry *dirArray = parsePath(pathname);
-  if (dirArray == NULL)
-  {
-    printf("Invalid directory path.\n");
-    return 0;
-  }
-  int found_entry = get_de_index(get_last_token(pathname), dirArray);
+  Dentry dentry;
 
   // must exist and be a directory
-  if (found_entry < 0 || dirArray[found_entry].attributes != 'd')
+  if (lookupPath(pathname, &dentry) != 0 || dentry.attributes != 'd')
   {
     return 0;
   }
@@ -317,54 +630,70 @@ int fs_isDir(char *pathname)
 }
 
 
-int fs_stat(const char *path, struct fs_stat *buf)
+// fill a stat buffer from a directory entry
+static void fillStat(const DirectoryEntry *entry, struct fs_stat *buf)
 {
-  // malloc mutable path string
-  char *pathname = malloc(strlen(path) + 1);
-  strcpy(pathname, path);
+  buf->st_size = entry->size;
+  buf->st_blksize = myVCB->block_size;
+  buf->st_blocks = entry->num_blocks;
+  buf->st_accesstime = entry->timeLastViewed;
+  buf->st_modtime = entry->timeLastModified;
+  buf->st_createtime = entry->timeCreated;
+
+  // a directory's size is kept in its own header since it grows
+  DirHeader header;
+  if (entry->attributes == 'd' && load_dir_header(entry->location, &header) == 0)
+  {
+    buf->st_blocks = header.num_blocks;
+    buf->st_size = (uint64_t)header.num_blocks * myVCB->block_size;
+  }
+}
 
-  // load directory
-  DirectoryEntry *dirArray = parsePath(pathname);
-  if (dirArray == NULL)
+// stat a path, a relative path starts at the directory at start
+static int statAt(uint64_t start, const char *path, struct fs_stat *buf)
+{
+  Dentry dentry;
+  if (lookupPathAt(start, path, &dentry) != 0)
   {
-    printf("Invalid path: %s\n", pathname);
+    printf("Invalid path: %s\n", path);
     return -1;
   }
 
-  // set directory entry index
-  int found_entry = get_de_index(get_last_token(pathname), dirArray);
+  // read the entry from the directory holding it
+  DirectoryEntry entry;
+  if (read_de(dentry.parent, dentry.index, &entry) != 0)
+  {
+    return -1;
+  }
 
   // Complete the fs_stat buffer
-  buf->st_size = dirArray[found_entry].size;
-  buf->st_blksize = myVCB->block_size;
-  buf->st_blocks = dirArray[found_entry].num_blocks;
-  buf->st_accesstime = dirArray[found_entry].timeLastViewed;
-  buf->st_modtime = dirArray[found_entry].timeLastModified;
-  buf->st_createtime = dirArray[found_entry].timeCreated;
-
-  // dirArray needs to be freed
-  free(dirArray);
-  dirArray = NULL;
+  fillStat(&entry, buf);
 
-  return found_entry;
+  return dentry.index;
 }
 
-// open directory interface
-fdDir *fs_opendir(const char *pathname)
+int fs_stat(const char *path, struct fs_stat *buf)
 {
-  
-  char *path = malloc(strlen(pathname) + 1);
-  strcpy(path, pathname);
-
+  return statAt(cw_dir_location, path, buf);
+}
 
-  DirectoryEntry *dirArray = parsePath(path);
+int fs_statat(fdDir *dirp, const char *name, struct fs_stat *buf)
+{
+  if (dirp == NULL)
+  {
+    return -1;
+  }
+  return statAt(dirp->directoryStartLocation, name, buf);
+}
 
-  char *last_token = get_last_token(path);
+// open a directory, a relative path starts at the directory at start
+static fdDir *opendirAt(uint64_t start, const char *pathname)
+{
 
-  int found = get_de_index(last_token, dirArray);
+  Dentry dentry;
 
   // check if a directory exists or not
-  if (found < 0 || dirArray[found].attributes != 'd')
+  if (lookupPathAt(start, pathname, &dentry) != 0 || dentry.attributes != 'd')
   {
     printf("Open directory failed.");
     return NULL;
@@ -372,31 +701,60 @@ fdDir *fs_opendir(const char *pathname)
 
   // malloc file descriptor
   fdDir *fdDir_arr = malloc(sizeof(fdDir));
+  struct fs_diriteminfo *di = malloc(sizeof(struct fs_diriteminfo));
+  DirCursor *cursor = malloc(sizeof(DirCursor));
+
+  // the directory header is read once here, entries follow in batches
+  if (fdDir_arr == NULL || di == NULL || cursor == NULL ||
+      open_dir_cursor(dentry.location, cursor) != 0)
+  {
+    free(fdDir_arr);
+    free(di);
+    free(cursor);
+    printf("Open directory failed.");
+    return NULL;
+  }
 
-  // Complete the information from the index found for directory
-  fdDir_arr->d_reclen = dirArray[found].num_blocks;
-  fdDir_arr->dirEntryPosition = found;
-  fdDir_arr->directoryStartLocation = dirArray[found].location;
+  // Complete the information from the dentry found for directory
+  fdDir_arr->d_reclen = sizeof(struct fs_diriteminfo);
+  fdDir_arr->dirEntryPosition = dentry.index;
+  fdDir_arr->directoryStartLocation = dentry.location;
   fdDir_arr->current_index = 0;
+  fdDir_arr->cursor = cursor;
+  fdDir_arr->sortedState = DE_SELF;
+  fdDir_arr->sortedLast[0] = '\0';
 
-  struct fs_diriteminfo *di = malloc(sizeof(struct fs_diriteminfo));
   fdDir_arr->di = di;
-  strcpy(fdDir_arr->di->d_name, last_token);
-  fdDir_arr->di->d_reclen = dirArray[found].num_blocks;
-  fdDir_arr->di->fileType = dirArray[found].attributes;
-
-  free(path);
-  path = NULL;
-  free(dirArray);
-  dirArray = NULL;
-  free(last_token);
-  last_token = NULL;
+  strcpy(fdDir_arr->di->d_name, dentry.name != NULL ? dentry.name : "");
+  fdDir_arr->di->d_reclen = sizeof(struct fs_diriteminfo);
+  fdDir_arr->di->fileType = dentry.attributes;
 
   return fdDir_arr;
 }
 
+// open directory interface
+fdDir *fs_opendir(const char *pathname)
+{
+  return opendirAt(cw_dir_location, pathname);
+}
+
+fdDir *fs_opendirat(fdDir *dirp, const char *name)
+{
+  if (dirp == NULL)
+  {
+    return NULL;
+  }
+  return opendirAt(dirp->directoryStartLocation, name);
+}
+
 // read directory interface, and return the current directory
 struct fs_diriteminfo *fs_readdir(fdDir *dirp)
+{
+  return fs_readdirplus(dirp, NULL);
+}
+
+// read the next entry together with its stat data, statbuf may be NULL
+struct fs_diriteminfo *fs_readdirplus(fdDir *dirp, struct fs_stat *statbuf)
 {
   if (dirp == NULL)
   {
@@ -404,38 +762,192 @@ struct fs_diriteminfo *fs_readdir(fdDir *dirp)
     return NULL;
   }
 
-  // malloc directory array and load into memory
-  int num_blocks = get_num_blocks(sizeof(DirectoryEntry) * DE_COUNT, myVCB->block_size);
-  int num_bytes = num_blocks * myVCB->block_size;
-  DirectoryEntry *dirArray = malloc(num_bytes);
-  LBAread(dirArray, num_blocks, dirp->directoryStartLocation);
+  // read the next live entry, NULL once the directory is exhausted
+  if (fs_readdirplus_batch(dirp, dirp->di, statbuf, 1) != 1)
+  {
+    return NULL;
+  }
+
+  return dirp->di;
+}
 
-  while (dirArray[dirp->current_index].attributes == 'a' && dirp->current_index < DE_COUNT - 1)
+// read up to max entries of an open directory in one call
+int fs_readdir_batch(fdDir *dirp, struct fs_diriteminfo *entries, int max)
+{
+  return fs_readdirplus_batch(dirp, entries, NULL, max);
+}
+
+// read up to max entries and, if stats is not NULL, their stat data
+int fs_readdirplus_batch(fdDir *dirp, struct fs_diriteminfo *entries,
+                         struct fs_stat *stats, int max)
+{
+  if (dirp == NULL || entries == NULL || max < 0)
   {
-    dirp->current_index++;
+    perror("Read directory failed.\n");
+    return -1;
   }
 
-  // return NULL if not found the current item index
-  if (dirp->current_index == DE_COUNT - 1)
+  int count = 0;
+  DirectoryEntry entry;
+
+  while (count < max && cursor_next(dirp->cursor, &entry) == 0)
   {
-    free(dirArray);
-    dirArray = NULL;
-    return NULL;
+    // fill in the information for the directory item info as appropriate
+    strcpy(entries[count].d_name, entry.name);
+    entries[count].d_reclen = dirp->d_reclen;
+    entries[count].fileType = entry.attributes;
+
+    // the stat data comes from the entry already in hand
+    if (stats != NULL)
+    {
+      fillStat(&entry, &stats[count]);
+    }
+    count++;
+  }
+
+  dirp->current_index = dirp->cursor->index;
+
+  return count;
+}
+
+// states of a sorted read after "." and ".."
+#define SORTED_FIRST 2 // from the first name
+#define SORTED_AFTER 3 // from the name after sortedLast
+#define SORTED_DONE 4  // nothing left
+
+// fill entry count of a read from a directory entry
+static void fillItem(fdDir *dirp, const DirectoryEntry *entry,
+                     struct fs_diriteminfo *entries, struct fs_stat *stats, int count)
+{
+  strcpy(entries[count].d_name, entry->name);
+  entries[count].d_reclen = dirp->d_reclen;
+  entries[count].fileType = entry->attributes;
+  if (stats != NULL)
+  {
+    fillStat(entry, &stats[count]);
+  }
+}
+
+// sorted read of up to max entries, only those matching pattern unless it
+// is NULL. The index is looked up again on every call, it may have been
+// rebuilt or changed since the last one.
+static int readSorted(fdDir *dirp, const char *pattern,
+                      struct fs_diriteminfo *entries, struct fs_stat *stats, int max)
+{
+  if (dirp == NULL || entries == NULL || max < 0)
+  {
+    perror("Read directory failed.\n");
+    return -1;
   }
 
-  // fill in the information for the directory item info as appropriate
-  strcpy(dirp->di->d_name, dirArray[dirp->current_index].name);
-  dirp->di->d_reclen = dirp->d_reclen;
-  dirp->di->fileType = dirArray[dirp->current_index].attributes;
+  uint64_t dir = dirp->directoryStartLocation;
+  int count = 0;
+  DirectoryEntry entry;
 
-  dirp->current_index++;
+  // "." and ".." lead the listing, a pattern never matches them
+  while (dirp->sortedState < SORTED_FIRST && count < max)
+  {
+    if (pattern == NULL)
+    {
+      if (read_de(dir, dirp->sortedState, &entry) != 0)
+      {
+        return -1;
+      }
+      fillItem(dirp, &entry, entries, stats, count++);
+    }
+    dirp->sortedState++;
+  }
+  if (count == max || dirp->sortedState == SORTED_DONE)
+  {
+    return count;
+  }
 
-  free(dirArray);
-  dirArray = NULL;
+  const DirIndex *index = dirIndexGet(dir);
+  if (index == NULL)
+  {
+    return -1;
+  }
 
+  // the pattern up to its first special character bounds the range
+  char prefix[256];
+  size_t prefix_len = 0;
+  if (pattern != NULL)
+  {
+    prefix_len = strcspn(pattern, "*?[\\");
+    if (prefix_len >= sizeof(prefix))
+    {
+      prefix_len = sizeof(prefix) - 1;
+    }
+  }
+  memcpy(prefix, pattern != NULL ? pattern : "", prefix_len);
+  prefix[prefix_len] = '\0';
+
+  int pos;
+  if (dirp->sortedState == SORTED_FIRST)
+  {
+    pos = dirIndexSeek(index, prefix, 0);
+  }
+  else
+  {
+    pos = dirIndexSeek(index, dirp->sortedLast, 1);
+  }
+
+  while (count < max)
+  {
+    if (pos == index->count || strncmp(index->names[pos], prefix, prefix_len) != 0)
+    {
+      dirp->sortedState = SORTED_DONE;
+      break;
+    }
+
+    const char *name = index->names[pos++];
+    strcpy(dirp->sortedLast, name);
+    dirp->sortedState = SORTED_AFTER;
+
+    if (pattern != NULL && fnmatch(pattern, name, FNM_PERIOD) != 0)
+    {
+      continue;
+    }
+    if (get_de_index(dir, name, &entry) < 0)
+    {
+      continue;
+    }
+    fillItem(dirp, &entry, entries, stats, count++);
+  }
+
+  return count;
+}
+
+// read the next entry in name order
+struct fs_diriteminfo *fs_readdir_sorted(fdDir *dirp)
+{
+  if (dirp == NULL || readSorted(dirp, NULL, dirp->di, NULL, 1) != 1)
+  {
+    return NULL;
+  }
   return dirp->di;
 }
 
+// read up to max entries in name order and, if stats is not NULL, their
+// stat data
+int fs_readdirplus_sorted(fdDir *dirp, struct fs_diriteminfo *entries,
+                          struct fs_stat *stats, int max)
+{
+  return readSorted(dirp, NULL, entries, stats, max);
+}
+
+// read up to max entries whose names match pattern, in name order
+int fs_readdir_glob(fdDir *dirp, const char *pattern,
+                    struct fs_diriteminfo *entries, struct fs_stat *stats, int max)
+{
+  if (pattern == NULL)
+  {
+    perror("Read directory failed.\n");
+    return -1;
+  }
+  return readSorted(dirp, pattern, entries, stats, max);
+}
+
 // fs_closedir close the directory of the file system
 int fs_closedir(fdDir *dirp)
 {
@@ -445,10 +957,12 @@ int fs_closedir(fdDir *dirp)
     return 0;
   }
 
+  free(dirp->cursor);
+  dirp->cursor = NULL;
   free(dirp->di);
   dirp->di = NULL;
   free(dirp);
   dirp = NULL;
 
   return 1;
-}
\ No newline at end of file
+}
@@ -22,6 +22,15 @@
 
 #include "b_io.h"
 #include "structure.h"
+#include "fsStats.h"
+#include "dentryCache.h"
+#include "directory.h"
+#include "inode.h"
+#include "blockRef.h"
+#include "dirBloom.h"
+#include "dirIndex.h"
+#include "pathParse.h"
+#include "fsWalk.h"
 #include <dirent.h>
 #include <sys/stat.h>
 
@@ -52,10 +61,28 @@ typedef struct
 	uint64_t directoryStartLocation;	/* To track DirectoryEntry location */
 	struct fs_diriteminfo *di; /* Pointer to the structure you return from read */
 	unsigned int current_index;			// current index for tracking readdir location
+	DirCursor *cursor;					// reads the directory a batch of entries at a time
+	int sortedState;					// where the next sorted read starts, see mfs.c
+	char sortedLast[256];				// last name a sorted read returned
 } fdDir;
 
-// Returns a directory (an array of directory entries)
-DirectoryEntry *parsePath(const char *path);
+// Returns the location of the directory holding the last component
+long resolveParent(const ParsedPath *path);
+long resolveParentAt(uint64_t start, const ParsedPath *path);
+
+// Resolves a whole path through the dentry cache, 0 if found. The
+// result's name is interned and only valid until the next cache insert
+int lookupPath(const char *path, Dentry *result);
+int lookupPathAt(uint64_t start, const char *path, Dentry *result);
+
+// Keep the current working directory right when a directory is moved
+void cwdMoved(uint64_t location, uint64_t old_parent, uint64_t new_parent, const char *name);
+
+// 1 if the directory at location is on the current working path
+int cwdInside(uint64_t location);
+
+// Release the current working directory stack
+void freeCwd();
 
 // Key directory functions
 int fs_mkdir(const char *pathname, mode_t mode);
@@ -88,4 +115,32 @@ struct fs_stat
 
 int fs_stat(const char *path, struct fs_stat *buf);
 
+// Handle-relative versions of the calls above. A relative name is looked
+// up from the open directory dirp instead of the current working
+// directory, so work inside one directory skips the path walk. An
+// absolute name behaves like the plain call.
+fdDir *fs_opendirat(fdDir *dirp, const char *name);
+int fs_statat(fdDir *dirp, const char *name, struct fs_stat *buf);
+int fs_mkdirat(fdDir *dirp, const char *name, mode_t mode);
+b_io_fd b_openat(fdDir *dirp, char *name, int flags);
+
+// Bulk and readdirplus iteration. The batch calls fill up to max entries
+// and return how many, 0 at the end or -1 on error. The plus calls also
+// fill stat data for each entry without another lookup.
+int fs_readdir_batch(fdDir *dirp, struct fs_diriteminfo *entries, int max);
+struct fs_diriteminfo *fs_readdirplus(fdDir *dirp, struct fs_stat *statbuf);
+int fs_readdirplus_batch(fdDir *dirp, struct fs_diriteminfo *entries,
+                         struct fs_stat *stats, int max);
+
+// Sorted iteration through the directory's name index. Entries come in
+// name order after "." and "..", and a read picks up after the last name
+// it returned, so entries added or removed in between are neither
+// repeated nor skipped. The glob call returns only names matching a
+// shell pattern and reads just the names sharing its literal prefix.
+struct fs_diriteminfo *fs_readdir_sorted(fdDir *dirp);
+int fs_readdirplus_sorted(fdDir *dirp, struct fs_diriteminfo *entries,
+                          struct fs_stat *stats, int max);
+int fs_readdir_glob(fdDir *dirp, const char *pattern,
+                    struct fs_diriteminfo *entries, struct fs_stat *stats, int max);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,69 @@
+/**************************************************************
+ * Class::  CSC-415-02 Spring 2024
+ * Name:: Thiha Aung, Min Ye Thway Khaing, Dylan Nguyen
+ * GitHub-Name:: thihaaung32
+ * Group-Name:: Bee
+ * Project:: Basic File System
+ *
+ * File:: pathParse.c
+ *
+ * Description:: Path tokenizer. Separators are overwritten with
+ *            terminators in a private copy of the path and the
+ *            components are recorded as they are found.
+ *
+ **************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include "pathParse.h"
+
+int parsePath(const char *path, ParsedPath *parsed)
+{
+  size_t length = strlen(path);
+  if (length >= MAX_PATH_LENGTH)
+  {
+    printf("Path is longer than %d characters\n", MAX_PATH_LENGTH - 1);
+    return -1;
+  }
+  memcpy(parsed->buffer, path, length + 1);
+
+  parsed->absolute = path[0] == '/';
+  parsed->count = 0;
+
+  char *p = parsed->buffer;
+  while (*p != '\0')
+  {
+    // skip the separators, repeated ones make no empty components
+    while (*p == '/')
+    {
+      *p++ = '\0';
+    }
+    if (*p == '\0')
+    {
+      break;
+    }
+
+    char *start = p;
+    while (*p != '\0' && *p != '/')
+    {
+      p++;
+    }
+    if (p - start > PATH_MAX_NAME)
+    {
+      printf("Name is longer than %d characters\n", PATH_MAX_NAME);
+      return -1;
+    }
+    parsed->component[parsed->count++] = start;
+  }
+
+  return 0;
+}
+
+const char *pathLast(const ParsedPath *parsed)
+{
+  if (parsed->count == 0)
+  {
+    return ".";
+  }
+  return parsed->component[parsed->count - 1];
+}
@@ -0,0 +1,42 @@
+/**************************************************************
+ * Class::  CSC-415-02 Spring 2024
+ * Name:: Thiha Aung, Min Ye Thway Khaing, Dylan Nguyen
+ * GitHub-Name:: thihaaung32
+ * Group-Name:: Bee
+ * Project:: Basic File System
+ *
+ * File:: pathParse.h
+ *
+ * Description:: Interface of the path tokenizer. A path is copied
+ *            once into a fixed buffer and split in place, so parsing
+ *            never allocates and the caller keeps the result on its
+ *            stack.
+ *
+ **************************************************************/
+
+#ifndef _PATH_PARSE_H
+#define _PATH_PARSE_H
+
+#include "structure.h"
+
+#define PATH_MAX_NAME 255                            // longest component, fits DirectoryEntry.name
+#define PATH_MAX_COMPONENTS (MAX_PATH_LENGTH / 2)    // "a/a/a..." is the worst case
+
+// A path split into its components. The components point into buffer,
+// so they stay valid as long as the ParsedPath does.
+typedef struct
+{
+  int absolute; // path started with '/'
+  int count;    // number of components
+  const char *component[PATH_MAX_COMPONENTS];
+  char buffer[MAX_PATH_LENGTH];
+} ParsedPath;
+
+// Splits path into parsed, 0 on success. Fails with -1 if the path is
+// longer than MAX_PATH_LENGTH or a component is longer than PATH_MAX_NAME.
+int parsePath(const char *path, ParsedPath *parsed);
+
+// The last component, "." for an empty path or "/"
+const char *pathLast(const ParsedPath *parsed);
+
+#endif
@@ -32,10 +32,11 @@ typedef u_int32_t uint32_t;
 
 #define DE_COUNT 64				// initial number of d_entries to allocate to a directory
 #define MAX_PATH_LENGTH 1024	// initial path length
-#define DEFAULT_FILE_BLOCKS 128 // initial number of blocks for new files
+#define DEFAULT_FILE_BLOCKS 128 // blocks reserved when a file outgrows its inode
+#define FS_VERSION 10			// bumped whenever the on-disk format changes
 
-// This is the directory entry structure for the file system
-// This struct is exactly 128 bytes in size
+// This is the directory entry structure for the file system, as handed
+// to callers. Directories store entries on disk as DirRecord.
 typedef struct
 {
 	time_t timeCreated;		 // time file was created
@@ -44,38 +45,75 @@ typedef struct
 	uint64_t location;		 // block location of file
 	uint64_t size;			 // size of the file in bytes
 	unsigned int num_blocks; // number of blocks
+	uint32_t inode;			 // inode holding the metadata, see inode.h
 
 	char name[256]; // name of file
 	unsigned char attributes; // attributes of file 
 	
 } DirectoryEntry;
 
-// This is the volume control block structure for the file system
+// This is the volume control block structure for the file system. Block
+// numbers and counts are 64 bits wide. magic and version sit where every
+// earlier format had them, so an older volume is recognized before its
+// layout is known.
 typedef struct
 {
-	int blockTotal;			 // number of blocks in the file system
-	int block_size;			 // size of each block in the file system
-	int fsLocation;			 // location of the first block of the freespace map
-	int freeSpaceStartBlock; // reference to the first free block in the drive
-	int freeBlocks;			 // number of blocks available in freespace
-	int freespace_size;		 // number of blocks that freespace occupies
-	int rootDirLocation;	 // block location of root
-	int root_blocks;		 // number of blocks the root directory occupies
-	long magic;				 // unique volume identifier
-	uint64_t signature;		 // our signature
-	time_t mounting_time;    
+	uint64_t blockTotal;		  // number of blocks in the file system
+	uint64_t fsLocation;		  // location of the first block of the freespace map
+	uint64_t freeSpaceStartBlock; // reference to the first free block in the drive
+	uint64_t freeBlocks;		  // number of blocks available in freespace
+	long magic;					  // unique volume identifier
+	uint64_t signature;			  // our signature
+	time_t mounting_time;
 	char volumeName[256];
+	int version;				  // on-disk format version, see FS_VERSION
+	int block_size;				  // size of each block in the file system
+	uint64_t freespace_size;	  // number of blocks that freespace occupies
+	uint64_t rootDirLocation;	  // block location of root
+	uint64_t root_blocks;		  // number of blocks the root directory occupies
+	uint64_t inodeTableLocation;  // first block of the inode table
+	uint64_t inodeTableBlocks;	  // blocks the inode table occupies
+	int inodeCount;				  // inodes in the table, inode 0 is never used
+	int inodeFree;				  // inodes not in use
+	int inodeNext;				  // where the search for a free inode starts
+	int mapLinkBytes;			  // bytes of one freespace map link, 4 or 8
+	uint64_t journalLocation;	  // first block of the journal region
+	uint64_t journalBlocks;		  // blocks the journal region occupies
+	uint64_t blockRefLocation;	  // first block of the block reference counts
+	uint64_t blockRefBlocks;	  // blocks the reference counts occupy
+	uint64_t summaryLocation;	  // block of the mount summary
 } VCB;
 
+// The volume control block of version 9 volumes, which mount upgrades
+typedef struct
+{
+	int blockTotal;
+	int block_size;
+	int fsLocation;
+	int freeSpaceStartBlock;
+	int freeBlocks;
+	int freespace_size;
+	int rootDirLocation;
+	int root_blocks;
+	long magic;
+	uint64_t signature;
+	time_t mounting_time;
+	char volumeName[256];
+	int version;
+	int inodeTableLocation;
+	int inodeTableBlocks;
+	int inodeCount;
+	int inodeFree;
+	int inodeNext;
+	int journalLocation;
+	int journalBlocks;
+	int blockRefLocation;
+	int blockRefBlocks;
+	int summaryLocation;
+} VCBv9;
+
 extern VCB *myVCB;					 // volume control block
-extern int *bitmap;					 // freespace map
 extern char *get_cwd;				 // get current working path string
-extern DirectoryEntry *cw_dir_array; // directory structure 
-
-int initRootDirectory(int parent_location);
-
-int get_de_index(char *token, DirectoryEntry *dirArray);
-
-int get_avail_de_idx(DirectoryEntry *dirArray);
+extern uint64_t cw_dir_location;	 // location of the current working directory
 
 #endif //STRUCTURE_H